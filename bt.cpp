@@ -0,0 +1,79 @@
+#include "elementals.h"
+#include "bt.h"
+
+namespace BT
+{
+	void link(node *nodes, ui32 count)
+	{
+		for (ui32 i = 0; i < count; i++)
+		{
+			ui32 end = i + 1;
+
+			while (end < count && nodes[end].depth > nodes[i].depth)
+			{
+				end++;
+			}
+
+			nodes[i].end = static_cast<ui16>(end);
+		}
+	}
+
+	// agents are reordered in place so the ones the node succeeded for end up in front
+
+	static ui32 evaluate(const node *nodes, ui32 index, const leafFn *leaves, void *context, ui32 *agents, ui32 count)
+	{
+		const node &n = nodes[index];
+
+		if (count == 0)
+		{
+			return 0;
+		}
+
+		switch (n.type)
+		{
+			case kSequence:
+			{
+				for (ui32 child = index + 1; child < n.end && count > 0; child = nodes[child].end)
+				{
+					count = evaluate(nodes, child, leaves, context, agents, count);
+				}
+
+				return count;
+			}
+
+			case kSelector:
+			{
+				ui32 done = 0;
+
+				for (ui32 child = index + 1; child < n.end && done < count; child = nodes[child].end)
+				{
+					done += evaluate(nodes, child, leaves, context, agents + done, count - done);
+				}
+
+				return done;
+			}
+
+			case kAll:
+			{
+				for (ui32 child = index + 1; child < n.end; child = nodes[child].end)
+				{
+					evaluate(nodes, child, leaves, context, agents, count);
+				}
+
+				return count;
+			}
+
+			case kLeaf:
+			{
+				return leaves[n.leaf](context, n, agents, count);
+			}
+		}
+
+		return 0;
+	}
+
+	void run(const node *nodes, const leafFn *leaves, void *context, ui32 *agents, ui32 count)
+	{
+		evaluate(nodes, 0, leaves, context, agents, count);
+	}
+}
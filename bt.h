@@ -0,0 +1,41 @@
+// BT stands for behaviour tree. A tree is a flat array of nodes in preorder,
+// written down with each node's depth so it reads like an outline, and it
+// runs for a whole list of agents at once: every node goes over all of the
+// agents that reached it before the next node runs. The leaves do the actual
+// work, they come from a table the caller passes in.
+
+namespace BT
+{
+	enum NodeType
+	{
+		kSequence = 0, // runs children in order, succeeds for agents that got through all of them
+		kSelector,     // runs children in order, succeeds for agents as soon as one child does
+		kAll,          // runs every child whatever they return, always succeeds
+		kLeaf          // a condition or an action from the leaf table
+	};
+
+	struct node
+	{
+		ui8 depth;
+		ui8 type;
+		ui8 leaf;
+		i16 a;
+		i16 b;
+		ui16 end; // one past the last node of the subtree, filled in by link()
+	};
+
+	// a leaf gets the agents that reached it and moves the ones it succeeds for to the front,
+	// returning how many; actions just return count
+	typedef ui32 (*leafFn)(void *context, const node &n, ui32 *agents, ui32 count);
+
+	// for leaves, moves agents[k] to the back of the group at the front that passed
+	inline void pass(ui32 *agents, ui32 &passed, ui32 k)
+	{
+		ui32 agent = agents[k];
+		agents[k] = agents[passed];
+		agents[passed++] = agent;
+	}
+
+	void link(node *nodes, ui32 count);
+	void run(const node *nodes, const leafFn *leaves, void *context, ui32 *agents, ui32 count);
+}
@@ -0,0 +1,455 @@
+#include <stdlib.h>
+#include "elementals.h"
+#include "fixed.h"
+#include "map.h"
+#include "collision.h"
+#include "rng.h"
+#include "simd.h"
+
+// The faster axis is a template parameter so the walk below compiles into one loop per axis with
+// plain field accesses; these pick the field.
+
+template<bool XFaster> static inline i32 &faster(pointi &p) { return XFaster ? p.x : p.y; }
+template<bool XFaster> static inline i32 &slower(pointi &p) { return XFaster ? p.y : p.x; }
+template<bool XFaster> static inline scalar &faster(vectors &v) { return XFaster ? v.x : v.y; }
+template<bool XFaster> static inline scalar &slower(vectors &v) { return XFaster ? v.y : v.x; }
+
+// Everything that tests boxes against tiles is a template on the tile shift as well, so MAP::grid can
+// turn pixels into tiles with constant shifts and inline its test into the walk. The entry points at the
+// bottom pick the instantiation for the loaded map out of tables indexed by MAP::tileSlot().
+
+// Solid tiles stop a box wherever it runs into them, one-way ones only when it's falling and its bottom
+// row has just come into their top row, so it can jump up through them and land on them.
+
+template<i32 Shift>
+static inline bool blocked(const recti &box, bool falling)
+{
+	if (MAP::grid<Shift>::collides(box))
+		return true;
+
+	const i32 bottom = box.y + box.height - 1;
+
+	return falling && MAP::grid<Shift>::inTile(bottom) == 0 && MAP::grid<Shift>::collides(recti(box.x, bottom, box.width, 1), MAP::kOneWay);
+}
+
+// what a box could run into, to rule a whole stretch of its walk out at once
+static inline ui8 blockingMask(bool falling) { return falling ? MAP::kSolid | MAP::kOneWay : MAP::kSolid; }
+
+// walks the box from p1 to p2 once the rectangle around both is known to hit something
+
+template<i32 Shift, bool XFaster>
+static bool sweep(state &prevState, state &curState, recti box, const pointi &p1, const pointi &p2, collision::info &collides, i32 stride)
+{
+	const pointi offs(box.x, box.y);
+	pointi from(p1), to(p2);
+
+	i32 dm = faster<XFaster>(to) > faster<XFaster>(from) ? 1 : -1;
+	scalar ds = slower<XFaster>(curState.velocity) / abs(faster<XFaster>(curState.velocity));
+	scalar offset_slower = scalar(slower<XFaster>(from));
+	pointi p(p1), prev(p);
+	const bool falling = curState.velocity.y > scalar(0);
+
+	// skip first step because it shouldn't collide with anything
+	offset_slower += ds;
+	slower<XFaster>(p) = (ds > scalar(0) ? ceilToInt(offset_slower) : floorToInt(offset_slower));
+	faster<XFaster>(p) += dm;
+
+	i32 steps = abs(faster<XFaster>(to) - faster<XFaster>(from));
+
+	for (i32 i = 0; i < steps; i++)
+	{
+		// coarse walks jump ahead while the box lands on free space, and go pixel by pixel once it doesn't
+
+		if (stride > 1 && i + 1 < steps)
+		{
+			i32 skip = (steps - i < stride ? steps - i : stride) - 1;
+			scalar skip_offset_slower = offset_slower + ds * scalar(skip);
+			pointi skip_p(p);
+
+			faster<XFaster>(skip_p) += dm * skip;
+
+			if (ds != scalar(0))
+				slower<XFaster>(skip_p) = (ds > scalar(0) ? ceilToInt(skip_offset_slower) : floorToInt(skip_offset_slower));
+
+			box.x = skip_p.x + offs.x;
+			box.y = skip_p.y + offs.y;
+
+			if (MAP::grid<Shift>::collides(box, blockingMask(falling)))
+			{
+				stride = 1;
+			}
+			else
+			{
+				p = skip_p;
+				offset_slower = skip_offset_slower;
+				i += skip;
+			}
+		}
+
+		box.x = p.x + offs.x;
+		box.y = p.y + offs.y;
+
+		if (blocked<Shift>(box, falling))
+		{
+			faster<XFaster>(p) = faster<XFaster>(prev);
+
+			box.x = p.x + offs.x;
+			box.y = p.y + offs.y;
+
+			if (blocked<Shift>(box, falling))
+			{
+				if (XFaster)
+					collides.set(slower<XFaster>(curState.velocity) > scalar(0) ? collision::BOTTOM : collision::TOP);
+				else
+					collides.set(slower<XFaster>(curState.velocity) > scalar(0) ? collision::RIGHT : collision::LEFT);
+
+				slower<XFaster>(curState.velocity) = scalar(0);
+				slower<XFaster>(prevState.position) = slower<XFaster>(curState.position) = scalar(slower<XFaster>(prev));
+			}
+			else
+			{
+				if (XFaster)
+					collides.set(dm > 0 ? collision::RIGHT : collision::LEFT);
+				else
+					collides.set(dm > 0 ? collision::BOTTOM : collision::TOP);
+
+				faster<XFaster>(curState.velocity) = scalar(0);
+				faster<XFaster>(prevState.position) = faster<XFaster>(curState.position) = scalar(faster<XFaster>(prev));
+			}
+
+			return true;
+		}
+
+		prev = p;
+
+		if (ds != scalar(0))
+		{
+			offset_slower += ds;
+			slower<XFaster>(p) = (ds > scalar(0) ? ceilToInt(offset_slower) : floorToInt(offset_slower));
+		}
+
+		faster<XFaster>(p) += dm;
+	}
+
+	return false;
+}
+
+// the pixels a body's walk goes from and to, rounded away from the direction it moves in at the start
+// and towards it at the end
+
+static inline void spanPixels(scalar prev, scalar cur, i32 &from, i32 &to)
+{
+	if (cur > prev)
+	{
+		from = floorToInt(prev);
+		to = ceilToInt(cur);
+	}
+	else
+	{
+		from = ceilToInt(prev);
+		to = floorToInt(cur);
+	}
+}
+
+// map_collision with the pixels already worked out
+
+template<i32 Shift>
+static bool collideSpan(state &prevState, state &curState, recti box, const pointi &p1, const pointi &p2, collision::info &collides, i32 stride)
+{
+	if (p1.x == p2.x && p1.y == p2.y)
+		return false;
+
+	recti rc(p1.x + box.x, p1.y + box.y, box.width, box.height);
+	rc.add(recti(p2.x + box.x, p2.y + box.y, box.width, box.height));
+
+	if (!MAP::grid<Shift>::collides(rc, blockingMask(curState.velocity.y > scalar(0))))
+		return false;
+
+	if (abs(curState.velocity.x) > abs(curState.velocity.y))
+		return sweep<Shift, true>(prevState, curState, box, p1, p2, collides, stride);
+
+	return sweep<Shift, false>(prevState, curState, box, p1, p2, collides, stride);
+}
+
+template<i32 Shift>
+static bool mapCollision(state &prevState, state &curState, recti box, collision::info &collides, i32 stride)
+{
+	pointi p1, p2;
+
+	spanPixels(prevState.position.x, curState.position.x, p1.x, p2.x);
+	spanPixels(prevState.position.y, curState.position.y, p1.y, p2.y);
+
+	return collideSpan<Shift>(prevState, curState, box, p1, p2, collides, stride);
+}
+
+// whether a column of tiles has anything solid between two rows, off the map counts as solid
+
+static bool solidColumn(i32 x, i32 top, i32 bottom)
+{
+	x = MAP::clampColumn(x);
+	bottom = MAP::clampRow(bottom);
+
+	for (i32 y = MAP::clampRow(top); y <= bottom; y++)
+	{
+		if (MAP::getProperties(x, y) & MAP::kSolid)
+			return true;
+	}
+
+	return false;
+}
+
+// whether a column holds up a body whose feet are just above row bottom, a one-way tile there doing so
+// as well when the feet are right on its top
+
+static bool floorColumn(i32 x, i32 top, i32 bottom, bool onTop)
+{
+	if (solidColumn(x, top, bottom))
+		return true;
+
+	return onTop && (MAP::getProperties(MAP::clampColumn(x), MAP::clampRow(bottom)) & MAP::kOneWay) != 0;
+}
+
+template<i32 Shift>
+static void mapContact(const vectors &position, recti box, collision::contact &contact)
+{
+	const i32 x = floorToInt(position.x);
+	const i32 y = floorToInt(position.y);
+
+	if (contact.revision == MAP::mapData.revision && contact.y == y && scalar(y) == position.y &&
+		x >= contact.supportMin && x <= contact.supportMax && x >= contact.freeMin && x <= contact.freeMax)
+	{
+		return;
+	}
+
+	typedef MAP::grid<Shift> grid;
+
+	const i32 left = x + box.x;
+	const i32 top = y + box.y;
+
+	contact.revision = 0;
+
+	if (scalar(y) != position.y || left < 0 || top < 0)
+		return;
+
+	// columns the box covers, and the rows it covers where it is and one pixel lower
+
+	const i32 first = grid::toTile(left);
+	const i32 last = grid::toTile(left + box.width - 1);
+	const i32 rowTop = grid::toTile(top);
+	const i32 rowBottom = grid::toTile(top + box.height - 1);
+	const i32 lowTop = grid::toTile(top + 1);
+	const i32 lowBottom = grid::toTile(top + box.height);
+	const bool onTop = grid::inTile(top + box.height) == 0;
+
+	// the box is clear where it is up to the nearest solid column on either side
+
+	for (i32 c = first; c <= last; c++)
+	{
+		if (solidColumn(c, rowTop, rowBottom))
+			return;
+	}
+
+	i32 wallLeft = first - 1;
+	i32 wallRight = last + 1;
+
+	while (!solidColumn(wallLeft, rowTop, rowBottom))
+		wallLeft--;
+
+	while (!solidColumn(wallRight, rowTop, rowBottom))
+		wallRight++;
+
+	// one pixel lower it runs into the floor, and keeps doing so over the whole run of floor columns under it
+
+	i32 floorLeft = -1;
+
+	for (i32 c = first; c <= last && floorLeft < 0; c++)
+	{
+		if (floorColumn(c, lowTop, lowBottom, onTop))
+			floorLeft = c;
+	}
+
+	if (floorLeft < 0)
+		return;
+
+	i32 floorRight = floorLeft;
+
+	while (floorLeft > 0 && floorColumn(floorLeft - 1, lowTop, lowBottom, onTop))
+		floorLeft--;
+
+	while (floorRight + 1 < MAP::getWidth() && floorColumn(floorRight + 1, lowTop, lowBottom, onTop))
+		floorRight++;
+
+	contact.y = y;
+	contact.supportMin = grid::toPixel(floorLeft) - box.width + 1 - box.x;
+	contact.supportMax = grid::toPixel(floorRight + 1) - 1 - box.x;
+	contact.freeMin = grid::toPixel(wallLeft + 1) - box.x;
+	contact.freeMax = grid::toPixel(wallRight) - box.width - box.x;
+	contact.revision = MAP::mapData.revision;
+}
+
+// Every shortcut below is map_collision followed through by hand for a body at contact.y that gravity
+// pulled down a bit: the first pixel down or along is inside the floor, so it's set straight back on
+// it, and a second walk along the floor either gets through or stops at the nearest wall.
+
+static bool restSpan(const state &prevState, state &curState, i32 from, i32 to, const collision::contact &contact, collision::info &collides)
+{
+	if (contact.revision != MAP::mapData.revision || prevState.position.y != scalar(contact.y) ||
+		!(curState.position.y > prevState.position.y))
+	{
+		return false;
+	}
+
+	const scalar vx = curState.velocity.x;
+	const scalar vy = curState.velocity.y;
+
+	// standing still, from is where map_collision would keep the box
+
+	if (curState.position.x == prevState.position.x)
+	{
+		if (vx != scalar(0) || from < contact.supportMin || from > contact.supportMax || from < contact.freeMin || from > contact.freeMax)
+			return false;
+
+		collides.set(collision::BOTTOM);
+		curState.velocity.y = scalar(0);
+		curState.position.y = scalar(contact.y);
+
+		return true;
+	}
+
+	// walking, x has to be the faster axis and the box has to stay over the floor the whole way
+
+	if (!(abs(vx) > abs(vy)))
+		return false;
+
+	const bool right = curState.position.x > prevState.position.x;
+	const scalar ds = vy / abs(vx);
+
+	if (from == to || (from < to ? from : to) < contact.supportMin || (from > to ? from : to) > contact.supportMax ||
+		from < contact.freeMin || from > contact.freeMax || !(ds > scalar(0)) || ceilToInt(scalar(contact.y) + ds) != contact.y + 1)
+	{
+		return false;
+	}
+
+	collides.set(collision::BOTTOM);
+	curState.velocity.y = scalar(0);
+	curState.position.y = scalar(contact.y);
+
+	if (right && to > contact.freeMax)
+	{
+		collides.set(collision::RIGHT);
+		curState.velocity.x = scalar(0);
+		curState.position.x = scalar(contact.freeMax);
+	}
+	else if (!right && to < contact.freeMin)
+	{
+		collides.set(collision::LEFT);
+		curState.velocity.x = scalar(0);
+		curState.position.x = scalar(contact.freeMin);
+	}
+
+	return true;
+}
+
+bool map_collision_resting(const state &prevState, state &curState, const collision::contact &contact, collision::info &collides)
+{
+	i32 from, to;
+
+	spanPixels(prevState.position.x, curState.position.x, from, to);
+
+	return restSpan(prevState, curState, from, to, contact, collides);
+}
+
+template<i32 Shift>
+static void mapCollisionBatch(scalar *posX, scalar *posY, const scalar *prevX, const scalar *prevY, scalar *velX, scalar *velY,
+	const ui8 *box, const recti *boxes, collision::info *collides, collision::contact *contacts, ui32 count, i32 stride)
+{
+	// the pixels every body walks between are worked out in vector lanes a block at a time, the walks
+	// themselves go body by body
+
+	const ui32 kBlock = 256;
+	i32 fromX[kBlock], toX[kBlock], fromY[kBlock], toY[kBlock];
+
+	for (ui32 begin = 0; begin < count; begin += kBlock)
+	{
+		const ui32 n = (count - begin < kBlock ? count - begin : kBlock);
+
+		SIMD::sweepSpans(prevX + begin, posX + begin, fromX, toX, n);
+		SIMD::sweepSpans(prevY + begin, posY + begin, fromY, toY, n);
+
+		for (ui32 k = 0; k < n; k++)
+		{
+			const ui32 i = begin + k;
+			const recti &rc = boxes[box[i]];
+			collision::info &c = collides[i];
+			state prev(vectors(prevX[i], prevY[i]), vectors(velX[i], velY[i]));
+			state cur(vectors(posX[i], posY[i]), vectors(velX[i], velY[i]));
+
+			c.reset();
+
+			if (!restSpan(prev, cur, fromX[k], toX[k], contacts[i], c))
+			{
+				if (cur.velocity.x != scalar(0) || cur.velocity.y != scalar(0))
+				{
+					collideSpan<Shift>(prev, cur, rc, pointi(fromX[k], fromY[k]), pointi(toX[k], toY[k]), c, stride);
+				}
+
+				if (c && (cur.velocity.x != scalar(0) || cur.velocity.y != scalar(0)))
+				{
+					mapCollision<Shift>(prev, cur, rc, c, stride);
+				}
+
+				if (c.bottom() && cur.velocity.y == scalar(0))
+				{
+					mapContact<Shift>(cur.position, rc, contacts[i]);
+				}
+				else
+				{
+					contacts[i].revision = 0;
+				}
+			}
+
+			posX[i] = cur.position.x;
+			posY[i] = cur.position.y;
+			velX[i] = cur.velocity.x;
+			velY[i] = cur.velocity.y;
+		}
+	}
+}
+
+// the entry points, one instantiation per tile size
+
+typedef bool (*mapCollisionFn)(state &prevState, state &curState, recti box, collision::info &collides, i32 stride);
+typedef void (*mapContactFn)(const vectors &position, recti box, collision::contact &contact);
+typedef void (*mapCollisionBatchFn)(scalar *posX, scalar *posY, const scalar *prevX, const scalar *prevY, scalar *velX, scalar *velY,
+	const ui8 *box, const recti *boxes, collision::info *collides, collision::contact *contacts, ui32 count, i32 stride);
+
+static const mapCollisionFn mapCollisionTable[MAP::kTileShifts] =
+{
+	mapCollision<3>, mapCollision<4>, mapCollision<5>, mapCollision<6>, mapCollision<7>
+};
+
+static const mapContactFn mapContactTable[MAP::kTileShifts] =
+{
+	mapContact<3>, mapContact<4>, mapContact<5>, mapContact<6>, mapContact<7>
+};
+
+static const mapCollisionBatchFn mapCollisionBatchTable[MAP::kTileShifts] =
+{
+	mapCollisionBatch<3>, mapCollisionBatch<4>, mapCollisionBatch<5>, mapCollisionBatch<6>, mapCollisionBatch<7>
+};
+
+bool map_collision(state &prevState, state &curState, recti box, collision::info &collides, i32 stride)
+{
+	return mapCollisionTable[MAP::tileSlot()](prevState, curState, box, collides, stride);
+}
+
+void map_contact(const vectors &position, recti box, collision::contact &contact)
+{
+	mapContactTable[MAP::tileSlot()](position, box, contact);
+}
+
+void map_collision_batch(scalar *posX, scalar *posY, const scalar *prevX, const scalar *prevY, scalar *velX, scalar *velY,
+	const ui8 *box, const recti *boxes, collision::info *collides, collision::contact *contacts, ui32 count, i32 stride)
+{
+	mapCollisionBatchTable[MAP::tileSlot()](posX, posY, prevX, prevY, velX, velY, box, boxes, collides, contacts, count, stride);
+}
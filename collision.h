@@ -0,0 +1,72 @@
+// Map collision for moving boxes. Bodies move pixel by pixel along their
+// faster axis until they hit a solid tile.
+
+struct state
+{
+	vectors position;
+	vectors velocity;
+
+	state(vectors pos = vectors(), vectors vel = vectors()) : position(pos), velocity(vel) { }
+};
+
+namespace collision
+{
+	enum collisionType
+	{
+		TOP = 0x01,
+		BOTTOM = 0x02,
+		LEFT = 0x04,
+		RIGHT = 0x08
+	};
+
+	class info
+	{
+	private:
+		ui8 data;
+
+	public:
+		info() : data(0) {}
+
+		bool top() { return (data & TOP) != 0; }
+		bool bottom() { return (data & BOTTOM) != 0; }
+		bool left() { return (data & LEFT) != 0; }
+		bool right() { return (data & RIGHT) != 0; }
+
+		void set(ui8 type) { data |= type; }
+		void unset(ui8 type) { data &= ~type; }
+		void reset() { data = 0; }
+
+		operator bool() { return data != 0; }
+	};
+
+	// the stretch of floor a body came to rest on, in positions of the body: at height y it's held up for
+	// any x in [supportMin, supportMax] and touches no wall for any x in [freeMin, freeMax]. It's only good
+	// for the map revision it was found at, revision 0 means there's none
+	struct contact
+	{
+		i32 y;
+		i32 supportMin;
+		i32 supportMax;
+		i32 freeMin;
+		i32 freeMax;
+		ui32 revision;
+	};
+}
+
+// stride > 1 walks that many pixels at a time while nothing's in the way, which is cheaper but can
+// miss the corner of a tile. Anything thicker than a stride still stops the box.
+bool map_collision(state &prevState, state &curState, recti box, collision::info &collides, i32 stride = 1);
+
+// finds the floor under a body resting at position, contact.revision is 0 if it isn't resting on any
+void map_contact(const vectors &position, recti box, collision::contact &contact);
+
+// moves a body that stood on its contact last step without walking the map, coming to exactly what
+// map_collision would have, walls included. Returns false if it can't tell and the map has to be walked.
+bool map_collision_resting(const state &prevState, state &curState, const collision::contact &contact, collision::info &collides);
+
+// A whole run of bodies kept in parallel arrays, the way ENT keeps them, each one resolved the way a step
+// does it: the resting shortcut when it applies, otherwise map_collision until it stops hitting things,
+// at most twice, and its contact brought up to date. box[i] picks the body's box out of boxes. Results are
+// the same as going body by body.
+void map_collision_batch(scalar *posX, scalar *posY, const scalar *prevX, const scalar *prevY, scalar *velX, scalar *velY,
+	const ui8 *box, const recti *boxes, collision::info *collides, collision::contact *contacts, ui32 count, i32 stride = 1);
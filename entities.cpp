@@ -0,0 +1,213 @@
+#include <stdlib.h>
+#include "elementals.h"
+#include "fixed.h"
+#include "rng.h"
+#include "collision.h"
+#include "entities.h"
+
+namespace ENT
+{
+	static void clear(store &s, ui32 i)
+	{
+		s.posX[i] = scalar(0);
+		s.posY[i] = scalar(0);
+		s.prevX[i] = scalar(0);
+		s.prevY[i] = scalar(0);
+		s.velX[i] = scalar(0);
+		s.velY[i] = scalar(0);
+		s.accX[i] = scalar(0);
+		s.accY[i] = scalar(0);
+		s.collides[i].reset();
+		s.contact[i].revision = 0;
+		s.flags[i] = 0;
+		s.lod[i] = 0;
+
+		s.sprite[i] = 0;
+		s.frame[i] = 0;
+		s.flip[i] = 0;
+		s.angle[i] = 0.0f;
+		s.animTime[i] = scalar(0);
+
+		s.kickStep[i] = 0;
+		s.isKicking[i] = 0;
+		s.kicked[i] = 0;
+		s.kickedTime[i] = scalar(0);
+		s.kickedVelX[i] = scalar(0);
+		s.kickedVelY[i] = scalar(0);
+		s.kickRequest[i] = 0;
+		s.kickTarget[i] = 0;
+
+		s.brain[i] = 0;
+		s.aiTime[i] = scalar(0);
+		s.thinkStep[i] = 0;
+		s.navCell[i] = 0;
+		s.navRoute[i] = 0;
+		s.willJump[i] = 0;
+		s.collided[i] = 0;
+		s.walkDirection[i] = 0;
+		s.willJumpDirection[i] = 0;
+		RNG::seed(s.rng[i], 0);
+	}
+
+	static void move(store &s, ui32 from, ui32 to)
+	{
+		s.posX[to] = s.posX[from];
+		s.posY[to] = s.posY[from];
+		s.prevX[to] = s.prevX[from];
+		s.prevY[to] = s.prevY[from];
+		s.velX[to] = s.velX[from];
+		s.velY[to] = s.velY[from];
+		s.accX[to] = s.accX[from];
+		s.accY[to] = s.accY[from];
+		s.collides[to] = s.collides[from];
+		s.contact[to] = s.contact[from];
+		s.flags[to] = s.flags[from];
+		s.lod[to] = s.lod[from];
+
+		s.sprite[to] = s.sprite[from];
+		s.frame[to] = s.frame[from];
+		s.flip[to] = s.flip[from];
+		s.angle[to] = s.angle[from];
+		s.animTime[to] = s.animTime[from];
+
+		s.kickStep[to] = s.kickStep[from];
+		s.isKicking[to] = s.isKicking[from];
+		s.kicked[to] = s.kicked[from];
+		s.kickedTime[to] = s.kickedTime[from];
+		s.kickedVelX[to] = s.kickedVelX[from];
+		s.kickedVelY[to] = s.kickedVelY[from];
+		s.kickRequest[to] = s.kickRequest[from];
+		s.kickTarget[to] = s.kickTarget[from];
+
+		s.brain[to] = s.brain[from];
+		s.aiTime[to] = s.aiTime[from];
+		s.thinkStep[to] = s.thinkStep[from];
+		s.navCell[to] = s.navCell[from];
+		s.navRoute[to] = s.navRoute[from];
+		s.willJump[to] = s.willJump[from];
+		s.collided[to] = s.collided[from];
+		s.walkDirection[to] = s.walkDirection[from];
+		s.willJumpDirection[to] = s.willJumpDirection[from];
+		s.rng[to] = s.rng[from];
+
+		s.id[to] = s.id[from];
+		s.slot[s.id[to] & 0xFFFF] = to;
+	}
+
+	void reset(store &s)
+	{
+		s.count = 0;
+		s.freeCount = kMaxEntities;
+
+		// hand out low slots first
+		for (ui32 i = 0; i < kMaxEntities; i++)
+		{
+			s.freeSlots[i] = kMaxEntities - 1 - i;
+			s.slot[i] = kMaxEntities;
+			s.generation[i] = 0;
+		}
+	}
+
+	handle spawn(store &s)
+	{
+		if (s.freeCount == 0)
+		{
+			return kInvalidHandle;
+		}
+
+		ui32 slot = s.freeSlots[--s.freeCount];
+		ui32 i = s.count++;
+		handle h = (static_cast<ui32>(s.generation[slot]) << 16) | slot;
+
+		clear(s, i);
+		s.id[i] = h;
+		s.slot[slot] = i;
+
+		return h;
+	}
+
+	void despawn(store &s, handle h)
+	{
+		if (!alive(s, h))
+		{
+			return;
+		}
+
+		ui32 slot = h & 0xFFFF;
+		ui32 last = s.count - 1;
+
+		if (s.slot[slot] != last)
+		{
+			move(s, last, s.slot[slot]);
+		}
+
+		s.generation[slot]++;
+		s.freeSlots[s.freeCount++] = slot;
+		s.count--;
+	}
+
+	template<typename T> static inline void exchange(T *array, ui32 a, ui32 b)
+	{
+		T t = array[a];
+		array[a] = array[b];
+		array[b] = t;
+	}
+
+	void swap(store &s, ui32 a, ui32 b)
+	{
+		if (a == b)
+		{
+			return;
+		}
+
+		exchange(s.posX, a, b);
+		exchange(s.posY, a, b);
+		exchange(s.prevX, a, b);
+		exchange(s.prevY, a, b);
+		exchange(s.velX, a, b);
+		exchange(s.velY, a, b);
+		exchange(s.accX, a, b);
+		exchange(s.accY, a, b);
+		exchange(s.collides, a, b);
+		exchange(s.contact, a, b);
+		exchange(s.flags, a, b);
+		exchange(s.lod, a, b);
+
+		exchange(s.sprite, a, b);
+		exchange(s.frame, a, b);
+		exchange(s.flip, a, b);
+		exchange(s.angle, a, b);
+		exchange(s.animTime, a, b);
+
+		exchange(s.kickStep, a, b);
+		exchange(s.isKicking, a, b);
+		exchange(s.kicked, a, b);
+		exchange(s.kickedTime, a, b);
+		exchange(s.kickedVelX, a, b);
+		exchange(s.kickedVelY, a, b);
+		exchange(s.kickRequest, a, b);
+		exchange(s.kickTarget, a, b);
+
+		exchange(s.brain, a, b);
+		exchange(s.aiTime, a, b);
+		exchange(s.thinkStep, a, b);
+		exchange(s.navCell, a, b);
+		exchange(s.navRoute, a, b);
+		exchange(s.willJump, a, b);
+		exchange(s.collided, a, b);
+		exchange(s.walkDirection, a, b);
+		exchange(s.willJumpDirection, a, b);
+		exchange(s.rng, a, b);
+
+		exchange(s.id, a, b);
+		s.slot[s.id[a] & 0xFFFF] = a;
+		s.slot[s.id[b] & 0xFFFF] = b;
+	}
+
+	bool alive(const store &s, handle h)
+	{
+		ui32 slot = h & 0xFFFF;
+
+		return h != kInvalidHandle && slot < kMaxEntities && s.generation[slot] == (h >> 16) && s.slot[slot] < s.count && s.id[s.slot[slot]] == h;
+	}
+}
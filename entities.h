@@ -0,0 +1,100 @@
+// ENT stands for entities. Every field of every entity gets its own array so
+// systems walk contiguous memory no matter how many characters are around.
+// Live entities are always packed in [0, count), handles stay valid across
+// the swaps that keep them packed and go stale once the entity is despawned.
+
+namespace ENT
+{
+#ifndef ENT_MAX_ENTITIES
+	const ui32 kMaxEntities = 8192;
+#else
+	const ui32 kMaxEntities = ENT_MAX_ENTITIES;
+#endif
+
+	// index in the low 16 bits, generation in the high 16 bits
+	typedef ui32 handle;
+
+	const handle kInvalidHandle = 0xFFFFFFFF;
+
+	enum Flags
+	{
+		kFlagCollides = 0x01,
+		kFlagDrawn = 0x02,
+		kFlagPlayer = 0x04,
+		kFlagAI = 0x08
+	};
+
+	struct store
+	{
+		ui32 count;
+
+		// physics
+
+		scalar posX[kMaxEntities];
+		scalar posY[kMaxEntities];
+		scalar prevX[kMaxEntities];
+		scalar prevY[kMaxEntities];
+		scalar velX[kMaxEntities];
+		scalar velY[kMaxEntities];
+		scalar accX[kMaxEntities];
+		scalar accY[kMaxEntities];
+		collision::info collides[kMaxEntities];
+		collision::contact contact[kMaxEntities]; // floor it's standing on, so it isn't swept every step
+		ui8 flags[kMaxEntities];
+		ui8 lod[kMaxEntities]; // simulation level of detail, see SIM
+
+		// animation
+
+		ui8 sprite[kMaxEntities];
+		ui8 frame[kMaxEntities];
+		ui8 flip[kMaxEntities];
+		f32 angle[kMaxEntities];
+		scalar animTime[kMaxEntities];
+
+		// kicks
+
+		ui32 kickStep[kMaxEntities];
+		ui8 isKicking[kMaxEntities];
+		ui8 kicked[kMaxEntities];
+		scalar kickedTime[kMaxEntities];
+		scalar kickedVelX[kMaxEntities];
+		scalar kickedVelY[kMaxEntities];
+		ui8 kickRequest[kMaxEntities];
+		ui32 kickTarget[kMaxEntities];
+
+		// ai
+
+		ui8 brain[kMaxEntities];
+		scalar aiTime[kMaxEntities];
+		ui32 thinkStep[kMaxEntities]; // step the agent is due to think again, see SIM
+		ui8 willJump[kMaxEntities];
+		ui8 collided[kMaxEntities];
+		ui8 walkDirection[kMaxEntities];
+		ui8 willJumpDirection[kMaxEntities];
+		RNG::stream rng[kMaxEntities];
+
+		// navigation, as cells and moves since NAV node and edge numbers depend on the edits made
+
+		ui32 navCell[kMaxEntities];  // cell of the last node the entity stood on, see NAV::cellOf()
+		ui32 navRoute[kMaxEntities]; // move it's making towards its goal, see NAV::routeOf()
+
+		// handle bookkeeping: dense index -> handle, handle index -> dense index
+
+		handle id[kMaxEntities];
+		ui32 slot[kMaxEntities];
+		ui16 generation[kMaxEntities];
+		ui32 freeSlots[kMaxEntities];
+		ui32 freeCount;
+	};
+
+	void reset(store &s);
+	handle spawn(store &s);
+	void despawn(store &s, handle h);
+	bool alive(const store &s, handle h);
+
+	// exchanges two live entities' dense indices, their handles keep pointing at them
+	void swap(store &s, ui32 a, ui32 b);
+
+	// dense index of a live entity, only valid until the next despawn
+	inline ui32 index(const store &s, handle h) { return s.slot[h & 0xFFFF]; }
+}
@@ -0,0 +1,269 @@
+#include <windows.h>
+#include <stdlib.h>
+#include "elementals.h"
+#include "jobs.h"
+
+namespace JOB
+{
+	// everything the pool is working on at the moment, chunks of every task are
+	// numbered one after the other so a single counter hands them all out
+
+	struct batch
+	{
+		const task *tasks[kMaxTasks];
+		ui32 chunkStart[kMaxTasks + 1];
+		ui32 chunkSize[kMaxTasks];
+		ui32 taskCount;
+		volatile LONG nextChunk;
+	};
+
+	static batch current;
+	static HANDLE threads[kMaxWorkers];
+	static ui32 nWorkers = 0;
+	static HANDLE wakeSemaphore = 0;
+	static HANDLE doneEvent = 0;
+	static volatile LONG checkedOut = 0;
+	static volatile LONG quit = 0;
+	static f64 secondsPerCount = 0.0;
+
+	static f64 seconds()
+	{
+		LARGE_INTEGER counter;
+
+		if (secondsPerCount == 0.0)
+		{
+			LARGE_INTEGER frequency;
+			QueryPerformanceFrequency(&frequency);
+			secondsPerCount = 1.0 / static_cast<f64>(frequency.QuadPart);
+		}
+
+		QueryPerformanceCounter(&counter);
+
+		return static_cast<f64>(counter.QuadPart) * secondsPerCount;
+	}
+
+	static void runChunks(batch &b)
+	{
+		const ui32 total = b.chunkStart[b.taskCount];
+
+		while (true)
+		{
+			ui32 chunk = static_cast<ui32>(InterlockedIncrement(&b.nextChunk) - 1);
+
+			if (chunk >= total)
+			{
+				break;
+			}
+
+			ui32 t = 0;
+
+			while (chunk >= b.chunkStart[t + 1])
+			{
+				t++;
+			}
+
+			const task &tk = *b.tasks[t];
+			ui32 begin = (chunk - b.chunkStart[t]) * b.chunkSize[t];
+			ui32 end = min(begin + b.chunkSize[t], tk.count);
+
+			if (begin < end)
+			{
+				tk.fn(tk.context, begin, end);
+			}
+		}
+	}
+
+	// each wake-up consumes one semaphore count and checks out once, the caller
+	// waits for all of them so no worker can wander into the next batch late
+
+	static DWORD WINAPI workerMain(LPVOID)
+	{
+		while (true)
+		{
+			WaitForSingleObject(wakeSemaphore, INFINITE);
+
+			if (quit)
+			{
+				break;
+			}
+
+			runChunks(current);
+
+			if (static_cast<ui32>(InterlockedIncrement(&checkedOut)) == nWorkers)
+			{
+				SetEvent(doneEvent);
+			}
+		}
+
+		return 0;
+	}
+
+	static void dispatch(const task **tasks, ui32 taskCount)
+	{
+		batch &b = current;
+		ui32 chunks = 0;
+
+		b.taskCount = taskCount;
+
+		for (ui32 t = 0; t < taskCount; t++)
+		{
+			const task &tk = *tasks[t];
+			ui32 grain = max(tk.grain, 1u);
+
+			// no point in cutting finer than the pool can chew
+			ui32 n = min((tk.count + grain - 1) / grain, (nWorkers + 1) * 4);
+
+			b.tasks[t] = tasks[t];
+			b.chunkStart[t] = chunks;
+			b.chunkSize[t] = (n > 0 ? (tk.count + n - 1) / n : 0);
+
+			chunks += n;
+		}
+
+		b.chunkStart[taskCount] = chunks;
+		b.nextChunk = 0;
+
+		if (nWorkers == 0 || chunks <= 1)
+		{
+			runChunks(b);
+			return;
+		}
+
+		checkedOut = 0;
+		ResetEvent(doneEvent);
+		ReleaseSemaphore(wakeSemaphore, nWorkers, 0);
+
+		runChunks(b);
+
+		WaitForSingleObject(doneEvent, INFINITE);
+	}
+
+	void init(i32 workers)
+	{
+		terminate();
+
+		if (workers < 0)
+		{
+			SYSTEM_INFO info;
+			GetSystemInfo(&info);
+			workers = static_cast<i32>(info.dwNumberOfProcessors) - 1;
+		}
+
+		nWorkers = min(static_cast<ui32>(max(workers, 0)), kMaxWorkers);
+
+		if (nWorkers == 0)
+		{
+			return;
+		}
+
+		quit = 0;
+		wakeSemaphore = CreateSemaphore(0, 0, nWorkers, 0);
+		doneEvent = CreateEvent(0, TRUE, FALSE, 0);
+
+		for (ui32 i = 0; i < nWorkers; i++)
+		{
+			threads[i] = CreateThread(0, 0, workerMain, 0, 0, 0);
+		}
+	}
+
+	void terminate()
+	{
+		if (nWorkers == 0)
+		{
+			return;
+		}
+
+		quit = 1;
+		ReleaseSemaphore(wakeSemaphore, nWorkers, 0);
+
+		for (ui32 i = 0; i < nWorkers; i++)
+		{
+			WaitForSingleObject(threads[i], INFINITE);
+			CloseHandle(threads[i]);
+		}
+
+		CloseHandle(wakeSemaphore);
+		CloseHandle(doneEvent);
+
+		nWorkers = 0;
+	}
+
+	ui32 workerCount()
+	{
+		return nWorkers;
+	}
+
+	void parallelFor(rangeFn fn, void *context, ui32 count, ui32 grain)
+	{
+		task tk;
+		tk.fn = fn;
+		tk.context = context;
+		tk.count = count;
+		tk.grain = grain;
+		tk.dependencies = 0;
+
+		const task *tasks[1] = { &tk };
+
+		dispatch(tasks, 1);
+	}
+
+	ui32 add(graph &g, rangeFn fn, void *context, ui32 count, ui32 grain, ui32 dependencies)
+	{
+		task &tk = g.tasks[g.taskCount];
+
+		tk.fn = fn;
+		tk.context = context;
+		tk.count = count;
+		tk.grain = grain;
+		tk.dependencies = dependencies;
+
+		return g.taskCount++;
+	}
+
+	void run(const graph &g, f64 *taskTime)
+	{
+		const ui32 all = (1u << g.taskCount) - 1;
+		ui32 done = 0;
+
+		while (done != all)
+		{
+			const task *ready[kMaxTasks];
+			ui32 readyIndex[kMaxTasks];
+			ui32 readyCount = 0;
+
+			for (ui32 i = 0; i < g.taskCount; i++)
+			{
+				const task &tk = g.tasks[i];
+
+				if (!(done & (1u << i)) && (tk.dependencies & done) == tk.dependencies)
+				{
+					ready[readyCount] = &tk;
+					readyIndex[readyCount] = i;
+					readyCount++;
+				}
+			}
+
+			// a dependency on a task that isn't in the graph, nothing else can run
+			if (readyCount == 0)
+			{
+				break;
+			}
+
+			f64 start = (taskTime ? seconds() : 0.0);
+
+			dispatch(ready, readyCount);
+
+			f64 share = (taskTime ? (seconds() - start) / readyCount : 0.0);
+
+			for (ui32 n = 0; n < readyCount; n++)
+			{
+				done |= (1u << readyIndex[n]);
+
+				if (taskTime)
+				{
+					taskTime[readyIndex[n]] = share;
+				}
+			}
+		}
+	}
+}
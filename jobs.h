@@ -0,0 +1,44 @@
+// JOB stands for jobs. A small pool of worker threads that splits index
+// ranges into chunks, plus a task graph on top so a step can be described as
+// ranges with dependencies between them. The calling thread always helps
+// out, so with zero workers everything just runs inline.
+
+namespace JOB
+{
+	const ui32 kMaxTasks = 16;
+	const ui32 kMaxWorkers = 31;
+
+	typedef void (*rangeFn)(void *context, ui32 begin, ui32 end);
+
+	struct task
+	{
+		rangeFn fn;
+		void *context;
+		ui32 count;
+		ui32 grain;
+		ui32 dependencies; // bitmask of the tasks in the same graph that must finish first
+	};
+
+	struct graph
+	{
+		task tasks[kMaxTasks];
+		ui32 taskCount;
+
+		graph() : taskCount(0) {}
+	};
+
+	// workers = -1 uses one per core besides the calling thread
+	void init(i32 workers = -1);
+	void terminate();
+	ui32 workerCount();
+
+	// runs fn over [0, count) in chunks of at least grain items, returns once every chunk is done
+	void parallelFor(rangeFn fn, void *context, ui32 count, ui32 grain);
+
+	// returns the index of the new task, to be used in other tasks' dependency masks
+	ui32 add(graph &g, rangeFn fn, void *context, ui32 count, ui32 grain, ui32 dependencies = 0);
+
+	// tasks whose dependencies are done run together, each one is given an even
+	// share of the time its wave took in taskTime if it's not null
+	void run(const graph &g, f64 *taskTime = 0);
+}
@@ -1,62 +1,186 @@
 #include <windows.h>
 #include "inc/GL/glew.h"
 #include "inc/GL/glfw.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "elementals.h"
+#include "fixed.h"
 #include "textures.h"
 #include "map.h"
 #include "opengl.h"
+#include "collision.h"
+#include "rng.h"
+#include "entities.h"
+#include "projectiles.h"
+#include "simd.h"
+#include "jobs.h"
+#include "sim.h"
+#include "nav.h"
+#include "replay.h"
+#include "rollback.h"
 
-struct state
+sizei *g_screenSize = 0;
+
+// interpolated positions for rendering, kept out of the world since they aren't simulation state
+f32 g_drawX[ENT::kMaxEntities];
+f32 g_drawY[ENT::kMaxEntities];
+
+// what each tile of a layer draws as, worked out once whenever its tiles change rather than every frame:
+// the frame in its low bits and the flips on top, kNoFrame for nothing. Layers are cut into chunks of
+// kChunkSize by kChunkSize tiles that are only worked out when they're drawn, and again when an edit near
+// them or a new revision of the layer makes them stale. At most kMaxChunks of a layer's chunks hold frames
+// at once, the one drawn longest ago handing its frames over to the next one that needs them, so the
+// cache takes the same memory whatever the size of the map
+const ui32 kChunkShift = 5;
+const ui32 kChunkSize = 1 << kChunkShift;
+const ui32 kMaxChunks = 256;
+
+struct layerChunk
 {
-	vectorf position;
-	vectorf velocity;
+	ui16 *frames; // kChunkSize rows of kChunkSize, 0 if it doesn't hold any
+	ui32 drawn;   // the layer's clock when it was last drawn
+	bool stale;
+};
 
-	state(vectorf pos = vectorf(), vectorf vel = vectorf()) : position(pos), velocity(vel) { }
+struct layerCache
+{
+	layerChunk *chunks;
+	ui32 *kept;    // the chunks holding frames
+	ui32 keptCount;
+	ui32 clock;    // counts the times the layer's been drawn
+	ui32 width;    // in tiles
+	ui32 height;
+	ui32 columns;  // in chunks
+	ui32 rows;
+	ui32 revision; // of the tiles its chunks are up to date with, 0 if none are
 };
 
-namespace collision
+const ui16 kFlipX = 0x4000;
+const ui16 kFlipY = 0x8000;
+const ui16 kNoFrame = 0xFFFF;
+
+layerCache g_layerCaches[MAP::kLayers];
+
+void drawLayer(ui32 id, vectorf offset);
+void releaseLayers();
+int chooseTile(int x, int y, bool &flipX, bool &flipY);
+bool loadResources();
+SIM::input readInput();
+int runHeadless(ui32 steps, ui32 characters, ui32 chasers, ui32 seed, const REC::recording *replay, ui32 rollback, bool lod);
+void GLFWCALL windowResize(int width, int height);
+
+int CALLBACK WinMain(__in HINSTANCE hInstance, __in HINSTANCE hPrevInstance, __in LPSTR lpCmdLine, __in int nCmdShow)
 {
-	enum collisionType
+	// "-noavx" sticks to the SSE2 kernels
+
+	SIMD::init(strstr(lpCmdLine, "-noavx") == 0);
+
+	// "-nolod" runs every entity at full rate no matter how far from the camera it is
+
+	bool lod = (strstr(lpCmdLine, "-nolod") == 0);
+
+	// "-threads n" sets the number of worker threads, by default there's one per extra core
+
+	const char *threadsArg = strstr(lpCmdLine, "-threads");
+	i32 threads = -1;
+
+	if (threadsArg)
+	{
+		sscanf(threadsArg, "-threads %d", &threads);
+	}
+
+	JOB::init(threads);
+
+	// "-characters n" adds n extra rubies at random spots
+
+	const char *charactersArg = strstr(lpCmdLine, "-characters");
+	ui32 characters = 0;
+
+	if (charactersArg)
 	{
-		TOP = 0x01,
-		BOTTOM = 0x02,
-		LEFT = 0x04,
-		RIGHT = 0x08
-	};
+		sscanf(charactersArg, "-characters %u", &characters);
+	}
+
+	// "-chasers n" adds n rubies that go after the nearest player
 
-	class info
+	const char *chasersArg = strstr(lpCmdLine, "-chasers");
+	ui32 chasers = 0;
+
+	if (chasersArg)
 	{
-	private:
-		ui8 data;
+		sscanf(chasersArg, "-chasers %u", &chasers);
+	}
 
-	public:
-		info() : data(0) {}
+	// "-seed n" picks the random streams, the same seed and the same input give the same run
 
-		bool top() { return (data & TOP) != 0; }
-		bool bottom() { return (data & BOTTOM) != 0; }
-		bool left() { return (data & LEFT) != 0; }
-		bool right() { return (data & RIGHT) != 0; }
+	const char *seedArg = strstr(lpCmdLine, "-seed");
+	ui32 seed = 1;
 
-		void set(ui8 type) { data |= type; }
-		void unset(ui8 type) { data &= ~type; }
-		void reset() { data = 0; }
+	if (seedArg)
+	{
+		sscanf(seedArg, "-seed %u", &seed);
+	}
 
-		operator bool() { return data != 0; }
-	};
-}
+	// "-record file" saves the input of the session, "-replay file" plays one back with its own seed, crowd and level of detail
 
-sizei *g_screenSize = 0;
+	char recordFile[MAX_PATH] = "";
+	char replayFile[MAX_PATH] = "";
+	const char *recordArg = strstr(lpCmdLine, "-record");
+	const char *replayArg = strstr(lpCmdLine, "-replay");
+	REC::recording replay;
+	bool replaying = false;
 
-void drawMap(vectorf offset);
-int chooseTile(int x, int y, bool &flipX, bool &flipY);
-rectf boundingBox(i32 sprite_id, const pointf &pos);
-bool map_collision(state &prevState, state &curState, recti box, collision::info &collides);
-void GLFWCALL windowResize(int width, int height);
+	if (recordArg)
+	{
+		sscanf(recordArg, "-record %259s", recordFile);
+	}
 
-int CALLBACK WinMain(__in HINSTANCE hInstance, __in HINSTANCE hPrevInstance, __in LPSTR lpCmdLine, __in int nCmdShow)
-{
-	sizei screenSize(1280, 720);
+	if (replayArg && sscanf(replayArg, "-replay %259s", replayFile) == 1)
+	{
+		if (!REC::load(replay, replayFile))
+		{
+			exit(EXIT_FAILURE);
+		}
+
+		replaying = true;
+		seed = replay.seed;
+		characters = replay.characters;
+		chasers = replay.chasers;
+		lod = replay.lod;
+	}
+
+	// "-headless [steps]" runs the simulation without a window and writes a benchmark report
+
+	const char *headlessArg = strstr(lpCmdLine, "-headless");
+
+	if (headlessArg)
+	{
+		ui32 steps = 0;
+
+		if (replaying)
+		{
+			steps = replay.steps;
+		}
+		else if (sscanf(headlessArg, "-headless %u", &steps) != 1 || steps == 0)
+		{
+			steps = 100000;
+		}
+
+		// "-rollback n" makes every step go back n steps and simulate them again, like a late remote input would
+
+		const char *rollbackArg = strstr(lpCmdLine, "-rollback");
+		ui32 rollback = 0;
+
+		if (rollbackArg)
+		{
+			sscanf(rollbackArg, "-rollback %u", &rollback);
+		}
+
+		exit(runHeadless(steps, characters, chasers, seed, replaying ? &replay : 0, rollback, lod));
+	}
+
+	sizei screenSize(replaying ? replay.viewSize : sizei(1280, 720));
 	g_screenSize = &screenSize;
 
 	if (!GFX::init("perrotiled", screenSize, false))
@@ -66,78 +190,30 @@ int CALLBACK WinMain(__in HINSTANCE hInstance, __in HINSTANCE hPrevInstance, __i
 
 	glfwSetWindowSizeCallback(windowResize);
 
-	MAP::load("res\\map.png");
-	TX::load(TX::PerroFrames, "res\\perro_frames2.png", pointi(26, 79), sizei(52, 80));
-	TX::load(TX::Ruby, "res\\ruby.png", pointi(26, 79), sizei(52, 80));
-	TX::load(TX::Ground, "res\\map_ground.png", pointi(0, 0), sizei(32, 32), false);
-
-	// constants
-
-	const f32 kVel = 250.f;
-	const f32 kJump = 550.0f;
-	const f32 g = 9.8f * 150.0f;
-	const f32 kMaxKickedTime = 1.5f;
-
-	enum Direction { kNone, kLeft, kRight, kBottom, kTop };
-	enum Character { kPerro, kRuby };
-
-	// perro
-
-	state perroCur(vectorf(260.0f, 200.0f), vectorf(0.0f, 0.0f));
-	state perroPrev(perroCur);
-	state perroInt;
-	vectorf perroAcc(0.0f, g);
-	collision::info perroCollides;
-	f32 perroAngle = 0.0f;
-	ui32 perroFrame = 0;
-	bool perroFlip = false;
-	f32 perroAnimTime = -1.0f;
-	f64 perroKickTime = -1.0f;
-	bool perroIsKicking = false;
-	f32 perroKickedTime = kMaxKickedTime + 1.0f;
-	bool perroKicked = false;
-	vectorf perroKickedVel;
-
-	// ruby
-
-	state rubyCur(vectorf(560.0f, 200.0f), vectorf(0.0f, 0.0f));
-	state rubyPrev(rubyCur);
-	state rubyInt;
-	vectorf rubyAcc(0, g);
-	collision::info rubyCollides;
-	f32 rubyAngle = 0.0f;
-	ui32 rubyFrame = 0;
-	bool rubyFlip = false;
-	f32 rubyAnimTime = -1.0f;
-	f32 rubyAiTime = 0.0f;
-	bool rubyWillJump = false;
-	bool rubyCollided = false;
-	Direction rubyWalkDirection = kNone;
-	Direction rubyWillJumpDirection = kNone;
-	f64 rubyKickTime = -1.0f;
-	bool rubyIsKicking = false;
-	f32 rubyKickedTime = kMaxKickedTime + 1.0f;
-	bool rubyKicked = false;
-	vectorf rubyKickedVel;
-
-	// camera
-
-	Character cameraBindedTo = kPerro;
-	state cameraCur(vectorf(static_cast<f32>(screenSize.width / 2), static_cast<f32>(screenSize.height / 2)), vectorf(0.0f, 0.0f));
-	state cameraPrev(cameraCur);
-	state cameraInt;
-	vectorf cameraAcc;
+	loadResources();
+
+	SIM::world *world = new SIM::world;
+	SIM::init(*world, screenSize, seed);
+	SIM::spawnCrowd(*world, characters);
+	SIM::spawnCrowd(*world, chasers, SIM::kBrainChaser);
+	world->lod = lod;
+
+	ENT::store &entities = world->entities;
 
 	// input
 
-	bool keyCtrlPressed = false;
-	bool keySpacePressed = false;
 	bool keyF12Pressed = false;
+	REC::recording recording;
+	ui32 replayStep = 0;
+
+	if (recordFile[0])
+	{
+		REC::begin(recording, seed, characters, chasers, world->viewSize, world->lod);
+	}
 
 	// loop
 
-	f64 t = 0.0;
-	f32 dt = 0.01f;
+	const f32 dt = SIM::kStepTime;
 	f64 newTime = 0.0;
 	f64 frameTime = 0.0;
 	f64 currentTime = glfwGetTime();
@@ -145,7 +221,6 @@ int CALLBACK WinMain(__in HINSTANCE hInstance, __in HINSTANCE hPrevInstance, __i
 
 	bool running = true;
 	ui32 frameCount = 0;
-	ui32 stepCount = 0;
 	f64 startTime = glfwGetTime();
 	f64 totalTime = 0.0;
 
@@ -174,655 +249,541 @@ int CALLBACK WinMain(__in HINSTANCE hInstance, __in HINSTANCE hPrevInstance, __i
 
 		while (accumulator >= dt)
 		{
-			// general input
+			SIM::input in = readInput();
 
-			if (glfwGetKey(GLFW_KEY_ESC) || !glfwGetWindowParam(GLFW_OPENED))
+			if (replaying)
 			{
-				running = false;
-			}
-
-			if (glfwGetKey(GLFW_KEY_SPACE))
-			{
-				if (!keySpacePressed)
+				if (replayStep == replay.steps)
 				{
-					cameraBindedTo = (cameraBindedTo == kPerro ? kRuby : kPerro);
+					running = false;
+					break;
 				}
 
-				keySpacePressed = true;
+				// escape still works, everything else comes from the log
+				in = (in & SIM::kKeyExit) | replay.inputs[replayStep++];
 			}
-			else
+
+			if (in & SIM::kKeyExit)
 			{
-				keySpacePressed = false;
+				running = false;
 			}
 
-			// perro processing
-
-			perroPrev = perroCur;
+			SIM::step(*world, in);
 
-			if (perroKickedTime > kMaxKickedTime)
+			if (recordFile[0])
 			{
-				perroAngle = 0.0f;
-				perroCur.velocity.x = 0.0f;
-
-				if (perroCollides.bottom() && glfwGetKey(GLFW_KEY_UP))
-				{
-					perroCur.velocity.y = -kJump;
-				}
+				REC::record(recording, in);
+			}
 
-				if (!perroIsKicking || !perroCollides.bottom())
-				{
-					if (glfwGetKey(GLFW_KEY_LEFT))
-					{
-						perroFlip = false;
-						perroCur.velocity.x = -kVel;
-					}
-
-					if (glfwGetKey(GLFW_KEY_RIGHT))
-					{
-						perroFlip = true;
-						perroCur.velocity.x = kVel;
-					}
-				}
+			accumulator -= dt;
+		}
 
-				if (glfwGetKey(GLFW_KEY_LCTRL) || glfwGetKey(GLFW_KEY_RCTRL))
-				{
-					if (!keyCtrlPressed)
-					{
-						perroIsKicking = true;
-						perroKickTime = t;
-
-						rectf rcPerro = boundingBox(TX::PerroFrames, perroCur.position);
-						rectf rcRuby = boundingBox(TX::Ruby, rubyCur.position);
-
-						if (rcPerro.intersects(rcRuby))
-						{
-							rubyKicked = true;
-							rubyKickedTime = 0.0f;
-							rubyKickedVel = vectorf(-300.0f, -500.0f);
-
-							if (perroFlip)
-							{
-								rubyKickedVel.x = -rubyKickedVel.x;
-							}
-						}
-					}
-
-					keyCtrlPressed = true;
-				}
-				else
-				{
-					keyCtrlPressed = false;
-				}
-			}
-			else
-			{
-				perroAngle = 10.0f * (perroKickedVel.x > 0.0f ? -1.0f : 1.0f);
+		// frame interpolation
 
-				if (perroCollides.bottom())
-				{
-					perroKickedVel.x = perroKickedVel.x * 0.99f;
-				}
-			}
+		const f32 alpha = static_cast<f32>(accumulator / static_cast<f64>(dt));
 
-			if (perroCollides.right() || perroCollides.left())
-			{
-				perroKickedTime = kMaxKickedTime + 1.0f;
-			}
+		SIMD::interpolate(entities.posX, entities.prevX, g_drawX, entities.count, alpha);
+		SIMD::interpolate(entities.posY, entities.prevY, g_drawY, entities.count, alpha);
 
-			if (perroIsKicking && perroCollides.bottom())
-			{
-				perroCur.velocity.x = 0;
-				perroCur.velocity.y = 0;
-			}
+		const ui32 c = ENT::index(entities, world->camera);
 
-			if (perroIsKicking && (t - perroKickTime) > 0.1)
-			{
-				perroIsKicking = false;
-			}
+		vectorf cameraInt(g_drawX[c], g_drawY[c]);
 
-			if (perroKickedTime < kMaxKickedTime)
-			{
-				perroIsKicking = false;
+		// render
 
-				if (perroKicked)
-				{
-					perroCur.velocity.y = perroKickedVel.y;
-					perroKicked = false;
-				}
+		glClear(GL_COLOR_BUFFER_BIT);
 
-				perroCur.velocity.x = perroKickedVel.x;				
-				perroKickedTime += dt;
-			}
+		GFX::drawGradient(0, 0, static_cast<f32>(screenSize.width), static_cast<f32>(screenSize.height), GFX::RGBAf(0, 0, 1, 1), GFX::RGBAf(1, 1, 1, 1));
 
-			perroCur.velocity.x += perroAcc.x * dt;
-			perroCur.velocity.y += perroAcc.y * dt;
-			perroCur.position.x += perroCur.velocity.x * dt;
-			perroCur.position.y += perroCur.velocity.y * dt;
+		vectorf mapOffset(cameraInt.x - screenSize.width / 2, cameraInt.y - screenSize.height / 2);
 
-			// ruby processing
+		drawLayer(MAP::kLayerBackground, mapOffset);
+		drawLayer(MAP::kLayerCollision, mapOffset);
 
-			rubyPrev = rubyCur;
+		// players go in the second pass so they stay on top
 
-			if (rubyCollides)
+		for (int pass = 0; pass < 2; pass++)
+		{
+			for (ui32 i = 0; i < entities.count; i++)
 			{
-				rubyCollided = true;
-			}
+				if (!(entities.flags[i] & ENT::kFlagDrawn) || ((entities.flags[i] & ENT::kFlagPlayer) != 0) != (pass == 1))
+				{
+					continue;
+				}
 
-			if (rubyCollides.left() || rubyCollides.right())
-			{
-				rubyKickedTime = kMaxKickedTime + 1.0f;
+				GFX::drawTiledSprite(entities.sprite[i], entities.frame[i], g_drawX[i] - mapOffset.x, g_drawY[i] - mapOffset.y, entities.angle[i], 1.0f, entities.flip[i] != 0);
 			}
+		}
 
-			if (rubyKickedTime > kMaxKickedTime)
-			{
-				rubyAngle = 0.0f;
+		// projectiles are plain squares on top of the characters
 
-				rectf rcPerro = boundingBox(TX::PerroFrames, perroCur.position);
-				rectf rcRuby = boundingBox(TX::Ruby, rubyCur.position);
+		const PRJ::store &projectiles = world->projectiles;
 
-				if (rcPerro.intersects(rcRuby) && (rand() % 100) < 1) // TODO: add timer to this
-				{
-					rubyIsKicking = true;
-					rubyKickTime = t;
+		for (ui32 i = 0; i < projectiles.count; i++)
+		{
+			f32 x = toFloat(projectiles.prevX[i]) + (toFloat(projectiles.posX[i]) - toFloat(projectiles.prevX[i])) * alpha;
+			f32 y = toFloat(projectiles.prevY[i]) + (toFloat(projectiles.posY[i]) - toFloat(projectiles.prevY[i])) * alpha;
+			f32 size = static_cast<f32>(projectiles.size[i] > 0 ? projectiles.size[i] : 1);
 
-					perroKicked = true;
-					perroKickedTime = 0.0f;
-					perroKickedVel = vectorf(-300.0f, -500.0f);
+			GFX::drawGradient(x - size - mapOffset.x, y - size - mapOffset.y, 2.0f * size, 2.0f * size, GFX::RGBAf(1, 1, 0, 1), GFX::RGBAf(1, 0.5f, 0, 1));
+		}
 
-					if (rubyFlip)
-					{
-						perroKickedVel.x = -perroKickedVel.x;
-					}
-				}
+		drawLayer(MAP::kLayerForeground, mapOffset);
 
-				if (rubyCollides.right())
-				{
-					rubyWillJump = true;
-					rubyWillJumpDirection = rand() % 10 < 7 ? kRight : kLeft;
-				}
-				else if (rubyCollides.left())
-				{
-					rubyWillJump = true;
-					rubyWillJumpDirection = rand() % 10 < 7 ? kLeft : kRight;
-				}
+		glfwSwapBuffers();
 
-				if (rubyAiTime >= 1.0f && !rubyIsKicking)
-				{
-					rubyAiTime = 0.0f;
-				
-					if (rubyCollides.bottom() && (rand() % 100 < 20))
-					{
-						rubyCur.velocity.y = -kJump;
-					}
-
-					if (rubyWalkDirection == kNone || rubyCollided || (rand() % 100 < 10))
-					{
-						int r = rand() % 3;
-
-						if (r == 0)
-						{
-							rubyWalkDirection = kRight;
-						}
-						else if (r == 1)
-						{
-							rubyWalkDirection = kLeft;
-						}
-						else
-						{
-							rubyWalkDirection = kNone;
-						}
-					}
-				}
+		if (glfwGetKey(GLFW_KEY_F12))
+		{
+			if (!keyF12Pressed)
+			{
+				GFX::screenshot();
+			}
 
-				rubyAiTime += dt;
+			keyF12Pressed = true;
+		}
+		else
+		{
+			keyF12Pressed = false;
+		}
 
-				if (rubyCollides.bottom() && rubyWillJump)
-				{
-					rubyWillJump = false;
-					rubyCur.velocity.y = -kJump;
-					rubyWalkDirection = rubyWillJumpDirection;
-					rubyAiTime = 0.0f;
-				}
+		frameCount++;
+	}
 
-				rubyCur.velocity.x = 0.0f;
+	totalTime = glfwGetTime() - startTime;
+	f64 FPS = frameCount / totalTime;
 
-				if (rubyWalkDirection == kLeft)
-				{
-					rubyFlip = false;
-					rubyCur.velocity.x = -kVel;
-				}
-				else if (rubyWalkDirection == kRight)
-				{
-					rubyFlip = true;
-					rubyCur.velocity.x = kVel;
-				}
-			}
-			else
-			{
-				rubyAngle = 10.0f * (rubyKickedVel.x > 0.0f ? -1.0f : 1.0f);
+	delete world;
 
-				if (rubyCollides.bottom())
-				{
-					rubyKickedVel.x = rubyKickedVel.x * 0.99f;
-				}
+	if (recordFile[0])
+	{
+		REC::save(recording, recordFile);
+	}
 
-				rubyIsKicking = false;
+	REC::release(recording);
+	REC::release(replay);
 
-				if (rubyKicked)
-				{
-					rubyCur.velocity.y = rubyKickedVel.y;
-					rubyKicked = false;
-				}
+	JOB::terminate();
+	NAV::release();
+	releaseLayers();
+	MAP::unload();
+	GFX::terminate();
 
-				rubyCur.velocity.x = rubyKickedVel.x;				
-				rubyKickedTime += dt;
-			}
+	exit(EXIT_SUCCESS);
+}
 
-			if (rubyIsKicking && rubyCollides.bottom())
-			{
-				rubyCur.velocity.x = 0;
-				rubyCur.velocity.y = 0;
-			}
+bool loadResources()
+{
+	bool ok = MAP::load("res\\map.png");
 
-			if (rubyIsKicking && (t - rubyKickTime) > 0.1 || rubyKickedTime < kMaxKickedTime)
-			{
-				rubyIsKicking = false;
-			}
+	ok = TX::load(TX::PerroFrames, "res\\perro_frames2.png", pointi(26, 79), sizei(52, 80)) && ok;
+	ok = TX::load(TX::Ruby, "res\\ruby.png", pointi(26, 79), sizei(52, 80)) && ok;
+	ok = TX::load(TX::Ground, "res\\map_ground.png", pointi(0, 0), sizei(32, 32), false) && ok;
 
-			rubyCur.velocity.x += rubyAcc.x * dt;
-			rubyCur.velocity.y += rubyAcc.y * dt;
-			rubyCur.position.x += rubyCur.velocity.x * dt;
-			rubyCur.position.y += rubyCur.velocity.y * dt;
+	MAP::showLayer(MAP::kLayerCollision, TX::Ground);
 
-			// collision checks
+	if (ok)
+	{
+		ok = NAV::build(TX::Ruby);
+	}
 
-			recti rc;
-			state prev;
+	return ok;
+}
 
-			// perro collision check
+SIM::input readInput()
+{
+	SIM::input in = 0;
 
-			perroCollides.reset();
-			rc = boundingBox(TX::PerroFrames, pointf(0.0f, 0.0f));
-			prev = perroPrev;
+	if (glfwGetKey(GLFW_KEY_UP)) in |= SIM::kKeyUp;
+	if (glfwGetKey(GLFW_KEY_LEFT)) in |= SIM::kKeyLeft;
+	if (glfwGetKey(GLFW_KEY_RIGHT)) in |= SIM::kKeyRight;
+	if (glfwGetKey(GLFW_KEY_LCTRL) || glfwGetKey(GLFW_KEY_RCTRL)) in |= SIM::kKeyKick;
+	if (glfwGetKey(GLFW_KEY_SPACE)) in |= SIM::kKeyCamera;
+	if (glfwGetKey(GLFW_KEY_LSHIFT) || glfwGetKey(GLFW_KEY_RSHIFT)) in |= SIM::kKeyThrow;
+	if (glfwGetKey(GLFW_KEY_ESC) || !glfwGetWindowParam(GLFW_OPENED)) in |= SIM::kKeyExit;
 
-			if (perroCur.velocity.x != 0.0f || perroCur.velocity.y != 0.0f)
-			{
-				map_collision(prev, perroCur, rc, perroCollides);
-			}
+	return in;
+}
 
-			if (perroCollides && (perroCur.velocity.x != 0.0f || perroCur.velocity.y != 0.0f))
-			{
-				map_collision(prev, perroCur, rc, perroCollides);
-			}
+int runHeadless(ui32 steps, ui32 characters, ui32 chasers, ui32 seed, const REC::recording *replay, ui32 rollback, bool lod)
+{
+	// no window here, TX::load only fills in the sprite info since there is no context to upload textures to
 
-			// perro frame selection
+	if (!loadResources())
+	{
+		JOB::terminate();
+		return EXIT_FAILURE;
+	}
 
-			if (perroCur.velocity.x == 0.0f && perroCollides.bottom())
-			{
-				perroFrame = 0;
-				perroAnimTime = -1.0f;
-			}
-			else if (!perroCollides.bottom())
-			{
-				perroFrame = 1;
-				perroAnimTime = -1.0f;
-			}
-			else if (perroCur.velocity.x != 0.0f)
-			{
-				if (perroAnimTime == -1.0f)
-				{
-					perroFrame = 2;
-					perroAnimTime = 0.0f;
-				}
+	SIM::world *world = new SIM::world;
+	SIM::stats stats;
 
-				perroAnimTime += dt;
+	SIM::init(*world, replay ? replay->viewSize : sizei(1280, 720), seed);
+	SIM::spawnCrowd(*world, characters);
+	SIM::spawnCrowd(*world, chasers, SIM::kBrainChaser);
+	world->lod = lod;
 
-				if (perroAnimTime >= 0.1f)
-				{
-					perroFrame++;
-					if (perroFrame > 2) perroFrame = 1;
-					perroAnimTime = 0.0f;
-				}
-			}
+	ROLL::ring history;
+	f64 saveTime = 0.0;
+	f64 restoreTime = 0.0;
+	ui32 restores = 0;
+	bool restored = true;
 
-			if (perroIsKicking)
-			{
-				perroFrame = 3;
-			}
+	if (rollback > 0)
+	{
+		ROLL::init(history, rollback + 1);
+	}
 
-			// ruby collision check
+	f64 startTime = SIM::now();
 
-			rubyCollides.reset();
-			rc = boundingBox(TX::Ruby, pointf(0.0f, 0.0f));
-			prev = rubyPrev;
+	for (ui32 i = 0; i < steps; i++)
+	{
+		if (rollback > 0)
+		{
+			f64 t0 = SIM::now();
+			ROLL::save(history, *world);
+			saveTime += SIM::now() - t0;
+		}
 
-			if (rubyCur.velocity.x != 0.0f || rubyCur.velocity.y != 0.0f)
-			{
-				map_collision(prev, rubyCur, rc, rubyCollides);
-			}
+		SIM::step(*world, replay ? replay->inputs[i] : 0, &stats);
 
-			if (rubyCollides && (rubyCur.velocity.x != 0.0f || rubyCur.velocity.y != 0.0f))
-			{
-				map_collision(prev, rubyCur, rc, rubyCollides);
-			}
+		if (rollback > 0 && i + 1 >= rollback)
+		{
+			ui32 from = world->stepCount - rollback;
+			f64 t0 = SIM::now();
 
-			// ruby frame selection
+			// a step that can't be gone back to would leave the rest of the run measuring something else
 
-			if (rubyCur.velocity.x == 0.0f && rubyCollides.bottom())
+			if (!ROLL::restore(history, *world, from))
 			{
-				rubyFrame = 0;
-				rubyAnimTime = -1.0f;
+				restored = false;
+				break;
 			}
-			else if (!rubyCollides.bottom())
-			{
-				rubyFrame = 1;
-				rubyAnimTime = -1.0f;
-			}
-			else if (rubyCur.velocity.x != 0.0f)
-			{
-				if (rubyAnimTime == -1.0f)
-				{
-					rubyFrame = 2;
-					rubyAnimTime = 0.0f;
-				}
-
-				rubyAnimTime += dt;
 
-				if (rubyAnimTime >= 0.1f)
-				{
-					rubyFrame++;
-					if (rubyFrame > 2) rubyFrame = 1;
-					rubyAnimTime = 0.0f;
-				}
-			}
+			restoreTime += SIM::now() - t0;
+			restores++;
 
-			if (rubyIsKicking)
+			for (ui32 j = from; j <= i; j++)
 			{
-				rubyFrame = 3;
-			}
-
-			// camera
+				t0 = SIM::now();
+				ROLL::save(history, *world);
+				saveTime += SIM::now() - t0;
 
-			cameraPrev = cameraCur;
+				SIM::step(*world, replay ? replay->inputs[j] : 0, &stats);
+			}
+		}
+	}
 
-			vectorf cameraObjective = (cameraBindedTo == kPerro ? perroCur.position : rubyCur.position);
+	f64 wallTime = SIM::now() - startTime;
 
-			//cameraObjective.x += 100.0f * (cameraBindedTo == kPerro ? (perroFlip ? 1.0 : -1.0f) : (rubyFlip ? 1.0f : -1.0f));
+	FILE *file = fopen("benchmark.txt", "w");
 
-			const vectorf cameraMin(static_cast<f32>(screenSize.width / 2), static_cast<f32>(screenSize.height / 2));
-			const vectorf cameraMax(static_cast<f32>(MAP::getWidth() * MAP::getTileSize()) - screenSize.width / 2, static_cast<f32>(MAP::getHeight() * MAP::getTileSize()) - screenSize.height / 2);
+	if (file)
+	{
+		SIM::printStats(file, stats);
+		fprintf(file, "wall time:        %.6f s\n", wallTime);
+		fprintf(file, "entities:         %u\n", world->entities.count);
+		fprintf(file, "level of detail:  %u full, %u reduced, %u frozen\n", world->lodFull, world->lodReduced - world->lodFull, world->lodCount - world->lodReduced);
+		fprintf(file, "kernels:          %s\n", SIMD::levelName());
+		fprintf(file, "worker threads:   %u\n", JOB::workerCount());
+		fprintf(file, "seed:             %u\n", seed);
+		fprintf(file, "input:            %s\n", replay ? "replay" : "none");
+
+		if (rollback > 0)
+		{
+			fprintf(file, "rollback:         %u steps, %u restores%s\n", rollback, restores, restored ? "" : ", then one failed");
+			fprintf(file, "snapshot size:    %u bytes\n", static_cast<ui32>(sizeof(SIM::world)));
+			fprintf(file, "save:             %.3f us\n", saveTime / (stats.steps > 0 ? stats.steps : 1) * 1000000.0);
+			fprintf(file, "restore:          %.3f us\n", restoreTime / (restores > 0 ? restores : 1) * 1000000.0);
+		}
+		fprintf(file, "navigation:       %u nodes, %u edges, %u queries, %u searches, %u flow fields\n", NAV::navGraph.nodeCount, NAV::navGraph.edgeCount, NAV::navGraph.queries, NAV::navGraph.searches, NAV::navGraph.fields);
+		fprintf(file, "simulated time:   %.2f s\n", world->t);
+		fclose(file);
+	}
 
-			// keep camera within map bounds
-			cameraObjective.x = min(max(cameraMin.x, cameraObjective.x), cameraMax.x);
-			cameraObjective.y = min(max(cameraMin.y, cameraObjective.y), cameraMax.y);
+	delete world;
 
-			// this fix is for when you resize the window
-			cameraCur.position.x = min(max(cameraMin.x, cameraCur.position.x), cameraMax.x);
-			cameraCur.position.y = min(max(cameraMin.y, cameraCur.position.y), cameraMax.y);
+	ROLL::release(history);
+	JOB::terminate();
+	NAV::release();
+	MAP::unload();
 
-			vectorf cameraDistance = cameraObjective - cameraCur.position;
+	return (restored ? EXIT_SUCCESS : EXIT_FAILURE);
+}
 
-			cameraCur.velocity.x = cameraDistance.x * 2.5f;
-			cameraCur.velocity.y = cameraDistance.y * 2.5f;
+void GLFWCALL windowResize(int width, int height)
+{
+	g_screenSize->width = width;
+	g_screenSize->height = height;
 
-			if (abs(cameraCur.velocity.x) < 20.0f)
-			{
-				cameraCur.velocity.x = 0.0f;
-			}
+	GFX::setResolution(*g_screenSize);
+}
 
-			if (abs(cameraCur.velocity.y) < 20.0f)
-			{
-				cameraCur.velocity.y = 0.0f;
-			}
+// what a tile of the collision layer draws as, each material having its own run of frames in the atlas
+// laid out like the ground's
 
-			cameraCur.velocity.x += cameraAcc.x * dt;
-			cameraCur.velocity.y += cameraAcc.y * dt;
-			cameraCur.position.x += cameraCur.velocity.x * dt;
-			cameraCur.position.y += cameraCur.velocity.y * dt;
+static ui16 collisionFrame(i32 x, i32 y)
+{
+	const i32 material = MAP::getTile(x, y);
 
-			// step finished
+	if (material == MAP::kAir)
+	{
+		return kNoFrame;
+	}
 
-			t += dt;
-			accumulator -= dt;
-			stepCount++;
-		}
+	bool flipX, flipY;
 
-		// frame interpolation
+	const i32 frame = MAP::materials[material].atlasFirst + chooseTile(x, y, flipX, flipY);
 
-		const f32 alpha = static_cast<f32>(accumulator / static_cast<f64>(dt));
+	return static_cast<ui16>(frame | (flipX ? kFlipX : 0) | (flipY ? kFlipY : 0));
+}
 
-		perroInt.position.x = floorf(perroCur.position.x * alpha + perroPrev.position.x * (1.0f - alpha));
-		perroInt.position.y = floorf(perroCur.position.y * alpha + perroPrev.position.y * (1.0f - alpha));
+static void releaseChunks(layerCache &cache)
+{
+	for (ui32 k = 0; k < cache.columns * cache.rows; k++)
+	{
+		delete[] cache.chunks[k].frames;
+	}
 
-		rubyInt.position.x = floorf(rubyCur.position.x * alpha + rubyPrev.position.x * (1.0f - alpha));
-		rubyInt.position.y = floorf(rubyCur.position.y * alpha + rubyPrev.position.y * (1.0f - alpha));
+	delete[] cache.chunks;
+	delete[] cache.kept;
 
-		cameraInt.position.x = floorf(cameraCur.position.x * alpha + cameraPrev.position.x * (1.0f - alpha));
-		cameraInt.position.y = floorf(cameraCur.position.y * alpha + cameraPrev.position.y * (1.0f - alpha));
+	cache.chunks = 0;
+	cache.kept = 0;
+	cache.keptCount = 0;
+	cache.width = cache.height = 0;
+	cache.columns = cache.rows = 0;
+	cache.revision = 0;
+}
 
-		// render
+// brings a layer's cache up to date with its tiles as far as knowing which chunks are stale goes. After
+// edits to the collision layer only the chunks around the tiles that changed are, a decor layer changes
+// all at once
 
-		glClear(GL_COLOR_BUFFER_BIT);
+static layerCache &cacheLayer(ui32 id)
+{
+	layerCache &cache = g_layerCaches[id];
+	const MAP::layer &layer = MAP::layers[id];
+	const bool collision = (id == MAP::kLayerCollision);
+	const ui32 revision = (collision ? MAP::mapData.revision : layer.revision);
+	const ui32 width = (collision ? MAP::mapData.width : layer.width);
+	const ui32 height = (collision ? MAP::mapData.height : layer.height);
+
+	if (cache.width != width || cache.height != height)
+	{
+		releaseChunks(cache);
 
-		GFX::drawGradient(0, 0, static_cast<f32>(screenSize.width), static_cast<f32>(screenSize.height), GFX::RGBAf(0, 0, 1, 1), GFX::RGBAf(1, 1, 1, 1));
+		cache.width = width;
+		cache.height = height;
+		cache.columns = (width + kChunkSize - 1) >> kChunkShift;
+		cache.rows = (height + kChunkSize - 1) >> kChunkShift;
+		cache.chunks = (cache.columns * cache.rows > 0 ? new layerChunk[cache.columns * cache.rows] : 0);
+		cache.kept = (cache.columns * cache.rows > 0 ? new ui32[cache.columns * cache.rows] : 0);
 
-		vectorf mapOffset(cameraInt.position.x - screenSize.width / 2, cameraInt.position.y - screenSize.height / 2);
+		for (ui32 k = 0; k < cache.columns * cache.rows; k++)
+		{
+			cache.chunks[k].frames = 0;
+			cache.chunks[k].drawn = 0;
+			cache.chunks[k].stale = true;
+		}
+	}
 
-		drawMap(mapOffset);
+	if (cache.revision == revision)
+	{
+		return cache;
+	}
 
-		GFX::drawTiledSprite(TX::Ruby, rubyFrame, rubyInt.position.x - mapOffset.x, rubyInt.position.y - mapOffset.y, rubyAngle, 1.0f, rubyFlip);
-		GFX::drawTiledSprite(TX::PerroFrames, perroFrame, perroInt.position.x - mapOffset.x, perroInt.position.y - mapOffset.y, perroAngle, 1.0f, perroFlip);
+	if (collision && cache.revision != 0 && MAP::journalHas(cache.revision))
+	{
+		for (ui32 r = cache.revision + 1; r <= revision; r++)
+		{
+			const MAP::edit &e = MAP::editAt(r);
 
-		glfwSwapBuffers();
+			// a tile's frame depends on its neighbours
 
-		if (glfwGetKey(GLFW_KEY_F12))
-		{
-			if (!keyF12Pressed)
+			for (i32 cy = max(e.y - 1, 0) >> kChunkShift; cy <= min(e.y + 1, static_cast<i32>(height) - 1) >> kChunkShift; cy++)
 			{
-				GFX::screenshot();
+				for (i32 cx = max(e.x - 1, 0) >> kChunkShift; cx <= min(e.x + 1, static_cast<i32>(width) - 1) >> kChunkShift; cx++)
+				{
+					cache.chunks[cache.columns * cy + cx].stale = true;
+				}
 			}
-
-			keyF12Pressed = true;
 		}
-		else
+	}
+	else
+	{
+		for (ui32 k = 0; k < cache.columns * cache.rows; k++)
 		{
-			keyF12Pressed = false;
+			cache.chunks[k].stale = true;
 		}
-
-		frameCount++;
 	}
 
-	totalTime = glfwGetTime() - startTime;
-	f64 FPS = frameCount / totalTime;
-
-	MAP::unload();
-	GFX::terminate();
+	cache.revision = revision;
 
-	exit(EXIT_SUCCESS);
+	return cache;
 }
 
-void GLFWCALL windowResize(int width, int height)
-{
-	g_screenSize->width = width;
-	g_screenSize->height = height;
+// the frames of a chunk, worked out again if it's stale or didn't hold any. The collision layer goes
+// through chooseTile() and its materials' atlas runs, decor layers just hold their frames
 
-	GFX::setResolution(*g_screenSize);
-}
-
-bool map_collision(state &prevState, state &curState, recti box, collision::info &collides)
+static const ui16 *chunkFrames(layerCache &cache, ui32 id, ui32 cx, ui32 cy)
 {
-	pointi p1, p2, offs(box.x, box.y);
+	const ui32 index = cache.columns * cy + cx;
+	layerChunk &chunk = cache.chunks[index];
 
-	if (curState.position.x > prevState.position.x)
-	{
-		p1.x = (i32)floorf(prevState.position.x);
-		p2.x = (i32)ceilf(curState.position.x);
-	}
-	else
-	{
-		p1.x = (i32)ceilf(prevState.position.x);
-		p2.x = (i32)floorf(curState.position.x);
-	}
+	chunk.drawn = cache.clock;
 
-	if (curState.position.y > prevState.position.y)
+	if (!chunk.stale && chunk.frames)
 	{
-		p1.y = (i32)floorf(prevState.position.y);
-		p2.y = (i32)ceilf(curState.position.y);
+		return chunk.frames;
 	}
-	else
-	{
-		p1.y = (i32)ceilf(prevState.position.y);
-		p2.y = (i32)floorf(curState.position.y);
-	}
-
-	if (p1.x == p2.x && p1.y == p2.y)
-		return false;
 
-	recti rc(p1.x + offs.x, p1.y + offs.y, box.width, box.height);
-	rc.add(recti(p2.x + offs.x, p2.y + offs.y, box.width, box.height));
+	// takes over the frames of the chunk drawn longest ago once there are enough, unless that one's on
+	// screen too, which takes a screen with more than kMaxChunks of them on it
 
-	if (MAP::collides(rc))
+	if (!chunk.frames && cache.keptCount >= kMaxChunks)
 	{
-		bool y_faster = true;
-		i32 vectori::*fasteri = &vectori::y;
-		i32 vectori::*sloweri = &vectori::x;
-		f32 vectorf::*fasterf = &vectorf::y;
-		f32 vectorf::*slowerf = &vectorf::x;
+		ui32 oldest = 0;
 
-		if (abs(curState.velocity.x) > abs(curState.velocity.y))
+		for (ui32 k = 1; k < cache.keptCount; k++)
 		{
-			y_faster = false;
-			fasteri = &vectori::x;
-			sloweri = &vectori::y;
-			fasterf = &vectorf::x;
-			slowerf = &vectorf::y;
+			if (cache.chunks[cache.kept[k]].drawn < cache.chunks[cache.kept[oldest]].drawn)
+			{
+				oldest = k;
+			}
 		}
 
-		i32 dm = p2.*fasteri > p1.*fasteri ? 1 : -1;
-		f32 ds = curState.velocity.*slowerf / abs(curState.velocity.*fasterf);
-		f32 offset_slower = (f32)(p1.*sloweri);
-		f32 prev_offset_slower = offset_slower;
-		pointi p(p1), prev(p);
-
-		// skip first step because it shouldn't collide with anything
-		offset_slower += ds;
-		(p.*sloweri) = (i32)(ds > 0.0f ? ceilf(offset_slower) : floorf(offset_slower));
-		(p.*fasteri) += dm;
+		layerChunk &old = cache.chunks[cache.kept[oldest]];
 
-		i32 steps = abs(p2.*fasteri - p1.*fasteri);
-
-		for (i32 i = 0; i < steps; i++)
+		if (old.drawn != cache.clock)
 		{
-			box.x = p.x + offs.x;
-			box.y = p.y + offs.y;
-
-			if (MAP::collides(box))
-			{
-				p.*fasteri = prev.*fasteri;
-
-				box.x = p.x + offs.x;
-				box.y = p.y + offs.y;
-
-				if (MAP::collides(box))
-				{
-					if (y_faster)
-						collides.set(curState.velocity.*slowerf > 0.0f ? collision::RIGHT : collision::LEFT);
-					else
-						collides.set(curState.velocity.*slowerf > 0.0f ? collision::BOTTOM : collision::TOP);
-
-					curState.velocity.*slowerf = 0.0f;
-					prevState.position.*slowerf = curState.position.*slowerf = (f32)(prev.*sloweri);
-				}
-				else
-				{
-					if (y_faster)
-						collides.set(dm > 0 ? collision::BOTTOM : collision::TOP);
-					else
-						collides.set(dm > 0 ? collision::RIGHT : collision::LEFT);
+			chunk.frames = old.frames;
+			old.frames = 0;
+			cache.kept[oldest] = index;
+		}
+	}
 
-					curState.velocity.*fasterf = 0.0f;
-					prevState.position.*fasterf = curState.position.*fasterf = (f32)(prev.*fasteri);
-				}
+	if (!chunk.frames)
+	{
+		chunk.frames = new ui16[kChunkSize * kChunkSize];
+		cache.kept[cache.keptCount++] = index;
+	}
 
-				return true;
-			}
+	const ui32 left = cx << kChunkShift;
+	const ui32 top = cy << kChunkShift;
+	const ui32 right = min(left + kChunkSize, cache.width);
+	const ui32 bottom = min(top + kChunkSize, cache.height);
 
-			prev = p;
-			prev_offset_slower = offset_slower;
+	for (ui32 y = top; y < bottom; y++)
+	{
+		ui16 *row = chunk.frames + kChunkSize * (y - top);
 
-			if (ds != 0.0f)
+		for (ui32 x = left; x < right; x++)
+		{
+			if (id == MAP::kLayerCollision)
 			{
-				offset_slower += ds;
-				(p.*sloweri) = (i32)(ds > 0.0f ? ceilf(offset_slower) : floorf(offset_slower));
+				row[x - left] = collisionFrame(x, y);
 			}
+			else
+			{
+				const ui8 tile = MAP::getLayerTile(id, x, y);
 
-			(p.*fasteri) += dm;
+				row[x - left] = (tile != 0 ? static_cast<ui16>(tile - 1) : kNoFrame);
+			}
 		}
 	}
 
-	return false;
+	chunk.stale = false;
+
+	return chunk.frames;
 }
 
-rectf boundingBox(i32 sprite_id, const pointf &pos)
+// draws the tiles of a layer that are on screen, scrolled by its parallax
+
+void drawLayer(ui32 id, vectorf offset)
 {
-	TX::sprite &sprite = TX::sprites[sprite_id];
+	const MAP::layer &layer = MAP::layers[id];
 
-	return rectf(pos.x - (f32)sprite.origin.x + 10.0f, pos.y - (f32)sprite.origin.y + 2.0f, 32.0f, 77.0f);
-}
+	if (layer.texture < 0)
+	{
+		return;
+	}
 
-void drawMap(vectorf offset)
-{
-	f32 tileSize = static_cast<f32>(MAP::getTileSize());
+	layerCache &cache = cacheLayer(id);
+
+	if (cache.width == 0 || cache.height == 0)
+	{
+		return;
+	}
+
+	const i32 size = (id == MAP::kLayerCollision ? MAP::getTileSize() : static_cast<i32>(layer.tileSize));
+	const f32 tileSize = static_cast<f32>(size);
+
+	cache.clock++;
 
-	i32 w = MAP::getWidth();
-	i32 h = MAP::getHeight();
+	offset.x *= layer.parallax;
+	offset.y *= layer.parallax;
 
-	i32 x0 = max(0, static_cast<i32>(floor(offset.x / tileSize)));
-	i32 y0 = max(0, static_cast<i32>(floor(offset.y / tileSize)));
-	i32 x1 = min(w, static_cast<i32>(floor((offset.x + g_screenSize->width) / tileSize)));
-	i32 y1 = min(h, static_cast<i32>(floor((offset.y + g_screenSize->height) / tileSize)));
+	i32 x0 = max(0, floorToInt(offset.x) / size);
+	i32 y0 = max(0, floorToInt(offset.y) / size);
+	i32 x1 = min(static_cast<i32>(cache.width) - 1, floorToInt(offset.x + g_screenSize->width) / size);
+	i32 y1 = min(static_cast<i32>(cache.height) - 1, floorToInt(offset.y + g_screenSize->height) / size);
+
+	// row by row, a chunk at a time along each
 
 	for (i32 y = y0; y <= y1; y++)
 	{
-		for (i32 x = x0; x <= x1; x++)
+		for (i32 cx = x0 >> kChunkShift; cx <= x1 >> kChunkShift; cx++)
 		{
-			if (MAP::getTile(x, y))
-			{
-				vectorf pos(static_cast<f32>(x) * tileSize - offset.x, static_cast<f32>(y) * tileSize - offset.y);
+			const i32 first = cx << kChunkShift;
+			const ui16 *row = chunkFrames(cache, id, cx, y >> kChunkShift) + kChunkSize * (y & (kChunkSize - 1));
+			const i32 left = max(x0, first);
+			const i32 right = min(x1, first + static_cast<i32>(kChunkSize) - 1);
 
-				bool flipX, flipY;
+			for (i32 x = left; x <= right; x++)
+			{
+				const ui16 frame = row[x - first];
 
-				i32 idx = chooseTile(x, y, flipX, flipY);
+				if (frame != kNoFrame)
+				{
+					vectorf pos(static_cast<f32>(x) * tileSize - offset.x, static_cast<f32>(y) * tileSize - offset.y);
 
-				GFX::drawTiledSprite(TX::Ground, idx, pos.x, pos.y, 0, 1.0f, flipX, flipY);
+					GFX::drawTiledSprite(layer.texture, frame & ~(kFlipX | kFlipY), pos.x, pos.y, 0, 1.0f, (frame & kFlipX) != 0, (frame & kFlipY) != 0);
+				}
 			}
 		}
 	}
 }
 
+void releaseLayers()
+{
+	for (ui32 id = 0; id < MAP::kLayers; id++)
+	{
+		releaseChunks(g_layerCaches[id]);
+
+		MAP::unloadLayer(id);
+	}
+}
+
 int chooseTile(int x, int y, bool &flipX, bool &flipY)
 {
 	enum { kTop = 0, kRight, kBottom, kLeft, kTopLeft, kTopRight, kBottomRight, kBottomLeft };
 
-	const i32 w = MAP::getWidth();
-	const i32 h = MAP::getHeight();
-
-	const bool isOutsideTile = true;
+	// the map's solid border makes the neighbours of any tile on it safe to look at, off the map counting as solid
 
 	bool tile[8] = {};
 	bool shadow[8] = {};
 	int nInnerCorners = 0;
 	int nSideShadows = 0;
 
-	tile[kTop]    = (y > 0 ? MAP::getTile(x, y - 1) != 0 : isOutsideTile);
-	tile[kRight]  = (x < w ? MAP::getTile(x + 1, y) != 0 : isOutsideTile);
-	tile[kBottom] = (y < h ? MAP::getTile(x, y + 1) != 0 : isOutsideTile);
-	tile[kLeft]   = (x > 0 ? MAP::getTile(x - 1, y) != 0 : isOutsideTile);
+	tile[kTop]    = MAP::getTile(x, y - 1) != 0;
+	tile[kRight]  = MAP::getTile(x + 1, y) != 0;
+	tile[kBottom] = MAP::getTile(x, y + 1) != 0;
+	tile[kLeft]   = MAP::getTile(x - 1, y) != 0;
 
-	tile[kTopLeft]     = (x > 0 && y > 0 ? MAP::getTile(x - 1, y - 1) != 0 : isOutsideTile);
-	tile[kTopRight]    = (x < w && y > 0 ? MAP::getTile(x + 1, y - 1) != 0 : isOutsideTile);
-	tile[kBottomRight] = (x < w && y < h ? MAP::getTile(x + 1, y + 1) != 0 : isOutsideTile);
-	tile[kBottomLeft]  = (x > 0 && y < h ? MAP::getTile(x - 1, y + 1) != 0 : isOutsideTile);
+	tile[kTopLeft]     = MAP::getTile(x - 1, y - 1) != 0;
+	tile[kTopRight]    = MAP::getTile(x + 1, y - 1) != 0;
+	tile[kBottomRight] = MAP::getTile(x + 1, y + 1) != 0;
+	tile[kBottomLeft]  = MAP::getTile(x - 1, y + 1) != 0;
 
 	shadow[kTop]    = !tile[kTop];
 	shadow[kRight]  = !tile[kRight];
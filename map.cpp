@@ -1,13 +1,299 @@
 #include <stdlib.h>
+#include <string.h>
 #include "inc/FreeImage.h"
 #include "elementals.h"
+#include "fixed.h"
 #include "map.h"
+#include "rng.h"
+#include "simd.h"
+#include "jobs.h"
+
+// decoding below reads pixels in blue, green, red order
+#if FI_RGBA_BLUE != 0 || FI_RGBA_GREEN != 1 || FI_RGBA_RED != 2
+#error "MAP::load expects FreeImage's little endian pixel layout"
+#endif
 
 namespace MAP
 {
 	mapinfo mapData;
-	
-	bool load(const char *filename)
+	layer layers[kLayers];
+
+	// every material draws with the ground tiles until the atlas has art of its own for them
+	material materials[kMaxMaterials] =
+	{
+		{ 0, 0 },                       // kAir
+		{ kSolid, 0 },                  // kGround
+		{ kOneWay, 0 },                 // kPlatform
+		{ kSolid | kFrictionLow, 0 },   // kIce
+		{ kSolid | kHazard, 0 },        // kSpikes
+		{ kSolid | kBreakable, 0 }      // kBrick
+	};
+
+	static const collidesFn collidesTable[kTileShifts] =
+	{
+		grid<3>::collides, grid<4>::collides, grid<5>::collides, grid<6>::collides, grid<7>::collides
+	};
+
+	collidesFn collidesImpl = grid<5>::collides;
+
+	// points everything that's specialised on the tile size at mapData.tileSize's version
+	static bool selectTileSize()
+	{
+		for (ui32 shift = kMinTileShift; shift <= kMaxTileShift; shift++)
+		{
+			if (mapData.tileSize == (1u << shift))
+			{
+				mapData.tileShift = shift;
+				collidesImpl = collidesTable[shift - kMinTileShift];
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool create(ui32 width, ui32 height, ui32 border)
+	{
+		unload();
+
+		if (static_cast<ui64>(width) * height > kRunsThreshold && width >= kMaxRunsWidth)
+		{
+			return false;
+		}
+
+		if (border < 1)
+		{
+			border = 1;
+		}
+
+		mapData.width = width;
+		mapData.height = height;
+		mapData.border = border;
+
+		if (static_cast<ui64>(width) * height > kRunsThreshold)
+		{
+			mapData.rows = new runRow[height];
+
+			for (ui32 y = 0; y < height; y++)
+			{
+				mapData.rows[y].runs = new ui32[1];
+				mapData.rows[y].runs[0] = kAir;
+				mapData.rows[y].count = mapData.rows[y].capacity = 1;
+			}
+		}
+		else
+		{
+			mapData.stride = width + 2 * border;
+			mapData.memory = new ui8[mapData.stride * (height + 2 * border)];
+			mapData.data = mapData.memory + mapData.stride * border + border;
+
+			memset(mapData.memory, kGround, mapData.stride * (height + 2 * border));
+
+			for (ui32 y = 0; y < height; y++)
+			{
+				memset(mapData.data + mapData.stride * y, kAir, width);
+			}
+		}
+
+		mapData.journal = new edit[kJournalSize];
+		mapData.revision++;
+		mapData.journalStart = mapData.revision;
+
+		return true;
+	}
+
+	// makes room for count runs in a row, keeping the ones it has
+
+	static void reserveRuns(runRow &row, ui32 count)
+	{
+		if (count <= row.capacity)
+		{
+			return;
+		}
+
+		const ui32 capacity = (count > 2 * row.capacity ? count : 2 * row.capacity);
+		ui32 *runs = new ui32[capacity];
+
+		memcpy(runs, row.runs, row.count * sizeof(ui32));
+		delete[] row.runs;
+
+		row.runs = runs;
+		row.capacity = capacity;
+	}
+
+	// turns a row of tiles into runs
+
+	static void packRow(runRow &row, const ui8 *tiles, ui32 width)
+	{
+		ui32 count = 1;
+
+		for (ui32 x = 1; x < width; x++)
+		{
+			count += (tiles[x] != tiles[x - 1]);
+		}
+
+		row.count = 0;
+		reserveRuns(row, count);
+
+		row.runs[row.count++] = tiles[0];
+
+		for (ui32 x = 1; x < width; x++)
+		{
+			if (tiles[x] != tiles[x - 1])
+			{
+				row.runs[row.count++] = (x << 8) | tiles[x];
+			}
+		}
+	}
+
+	// puts a different tile in a row of runs: the run it lands in is split around it, and it joins the run
+	// before or after it when they're of the same material, so runs never repeat one
+
+	static void setRun(runRow &row, i32 x, ui8 tile)
+	{
+		const ui32 k = runAt(row, x);
+		const i32 start = static_cast<i32>(row.runs[k] >> 8);
+		const i32 end = (k + 1 < row.count ? static_cast<i32>(row.runs[k + 1] >> 8) : static_cast<i32>(mapData.width));
+		const ui8 old = static_cast<ui8>(row.runs[k] & 0xFF);
+		const bool joinBefore = (x == start && k > 0 && (row.runs[k - 1] & 0xFF) == tile);
+		const bool joinAfter = (x + 1 == end && k + 1 < row.count && (row.runs[k + 1] & 0xFF) == tile);
+
+		// runs [first, last) make way for the ones in with
+
+		const ui32 first = (joinBefore ? k - 1 : k);
+		const ui32 last = (joinAfter ? k + 2 : k + 1);
+		ui32 with[3];
+		ui32 n = 0;
+
+		if (joinBefore)
+		{
+			with[n++] = row.runs[k - 1];
+		}
+		else
+		{
+			if (x > start)
+			{
+				with[n++] = row.runs[k];
+			}
+
+			with[n++] = (static_cast<ui32>(x) << 8) | tile;
+		}
+
+		if (!joinAfter && x + 1 < end)
+		{
+			with[n++] = (static_cast<ui32>(x + 1) << 8) | old;
+		}
+
+		const ui32 count = row.count - (last - first) + n;
+
+		reserveRuns(row, count);
+		memmove(row.runs + first + n, row.runs + last, (row.count - last) * sizeof(ui32));
+		memcpy(row.runs + first, with, n * sizeof(ui32));
+
+		row.count = count;
+	}
+
+	bool setTile(i32 x, i32 y, ui8 tile)
+	{
+		if (x < 0 || y < 0 || x >= getWidth() || y >= getHeight())
+		{
+			return false;
+		}
+
+		const ui8 before = static_cast<ui8>(getTile(x, y));
+
+		if (before == tile)
+		{
+			return false;
+		}
+
+		if (mapData.data)
+		{
+			mapData.data[static_cast<i32>(mapData.stride) * y + x] = tile;
+		}
+		else
+		{
+			setRun(mapData.rows[y], x, tile);
+		}
+
+		edit &e = mapData.journal[++mapData.revision & (kJournalSize - 1)];
+		e.x = x;
+		e.y = y;
+		e.before = before;
+		e.after = tile;
+
+		return true;
+	}
+
+	// each undo is journaled in the slot of an edit kJournalSize earlier, so they only stay clear of the
+	// ones still to undo for up to half the journal
+
+	bool rewind(ui32 revision)
+	{
+		const ui32 newest = mapData.revision;
+
+		if (!journalHas(revision) || newest - revision > kJournalSize / 2)
+		{
+			return false;
+		}
+
+		for (ui32 r = newest; r > revision; r--)
+		{
+			const edit e = editAt(r);
+
+			setTile(e.x, e.y, e.before);
+		}
+
+		return true;
+	}
+
+	// rows of the image go to the pool in chunks this big, a few hundred kilobytes for wide maps
+	const ui32 kDecodeGrain = 64;
+
+	static const paletteEntry defaultPalette[] = { { 0x000000, kGround } };
+
+	struct decodeJob
+	{
+		const ui8 *bits;
+		ui32 pitch;
+		ui32 bytesPerPixel;
+		ui32 colors[SIMD::kMaxPalette];
+		ui8 tiles[SIMD::kMaxPalette];
+		ui32 paletteCount;
+		ui8 *out;
+		ui32 stride;
+		ui32 width;
+		ui32 height;
+	};
+
+	// FreeImage keeps images bottom up. Without an out the map is kept as runs, each row being decoded into
+	// scratch first
+	static void decodeRows(void *context, ui32 begin, ui32 end)
+	{
+		const decodeJob &job = *static_cast<const decodeJob *>(context);
+		ui8 *scratch = (job.out ? 0 : new ui8[job.width]);
+
+		for (ui32 y = begin; y < end; y++)
+		{
+			const ui8 *row = job.bits + job.pitch * (job.height - y - 1);
+
+			if (scratch)
+			{
+				SIMD::decodePixels(row, job.bytesPerPixel, job.colors, job.tiles, job.paletteCount, scratch, job.width);
+				packRow(mapData.rows[y], scratch, job.width);
+			}
+			else
+			{
+				SIMD::decodePixels(row, job.bytesPerPixel, job.colors, job.tiles, job.paletteCount, job.out + job.stride * y, job.width);
+			}
+		}
+
+		delete[] scratch;
+	}
+
+	// the image as 24 or 32 bit pixels, 0 if it can't be read
+	static FIBITMAP *openImage(const char *filename)
 	{
 		FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(filename, 0);
 
@@ -18,41 +304,261 @@ namespace MAP
 
 		if (fif == FIF_UNKNOWN || !FreeImage_FIFSupportsReading(fif))
 		{
-			return false;
+			return 0;
 		}
 
 		FIBITMAP *dib = FreeImage_Load(fif, filename);
 
 		if (!dib)
+		{
+			return 0;
+		}
+
+		// anything but 24 and 32 bit pixels is converted first
+
+		if (FreeImage_GetBPP(dib) != 24 && FreeImage_GetBPP(dib) != 32)
+		{
+			FIBITMAP *converted = FreeImage_ConvertTo32Bits(dib);
+			FreeImage_Unload(dib);
+			dib = converted;
+		}
+
+		return dib;
+	}
+
+	// decodes the whole image into width by height tiles starting at out, rows stride apart
+	static void decodeImage(FIBITMAP *dib, const paletteEntry *palette, ui32 paletteCount, ui8 *out, ui32 stride)
+	{
+		decodeJob job;
+		job.bits = FreeImage_GetBits(dib);
+		job.pitch = FreeImage_GetPitch(dib);
+		job.bytesPerPixel = FreeImage_GetBPP(dib) / 8;
+		job.paletteCount = paletteCount;
+
+		for (ui32 k = 0; k < job.paletteCount; k++)
+		{
+			job.colors[k] = palette[k].color & 0xFFFFFF;
+			job.tiles[k] = palette[k].tile;
+		}
+
+		job.out = out;
+		job.stride = stride;
+		job.width = FreeImage_GetWidth(dib);
+		job.height = FreeImage_GetHeight(dib);
+
+		JOB::parallelFor(decodeRows, &job, job.height, kDecodeGrain);
+	}
+
+	bool load(const char *filename, ui32 border, const paletteEntry *palette, ui32 paletteCount)
+	{
+		if (!selectTileSize() || paletteCount > SIMD::kMaxPalette)
 		{
 			return false;
 		}
 
-		mapData.width = FreeImage_GetWidth(dib);
-		mapData.height = FreeImage_GetHeight(dib);
-		i32 bpp = FreeImage_GetLine(dib) / mapData.width;
+		FIBITMAP *dib = openImage(filename);
+
+		if (!dib)
+		{
+			return false;
+		}
 
-		mapData.data = new ui8[mapData.width * mapData.height];
+		if (!palette)
+		{
+			palette = defaultPalette;
+			paletteCount = sizeof(defaultPalette) / sizeof(defaultPalette[0]);
+		}
 
-		for (ui32 y = 0; y < mapData.height; y++)
+		if (!create(FreeImage_GetWidth(dib), FreeImage_GetHeight(dib), border))
 		{
-			ui8 *bits = FreeImage_GetScanLine(dib, mapData.height - y - 1);
+			FreeImage_Unload(dib);
+			return false;
+		}
 
-			for (ui32 x = 0; x < mapData.width; x++)
+		decodeImage(dib, palette, paletteCount, mapData.data, mapData.stride);
+
+		FreeImage_Unload(dib);
+
+		return true;
+	}
+
+	static const char *const layerNames[kLayers] = { "background", "collision", "foreground" };
+
+	const char *layerName(ui32 id)
+	{
+		return (id < kLayers ? layerNames[id] : 0);
+	}
+
+	ui32 findLayer(const char *name)
+	{
+		for (ui32 id = 0; id < kLayers; id++)
+		{
+			if (strcmp(name, layerNames[id]) == 0)
 			{
-				ui32 color = (bits[FI_RGBA_RED] << 16) | (bits[FI_RGBA_GREEN] << 8) | (bits[FI_RGBA_BLUE]);
-				mapData.data[mapData.width * y + x] = (color == 0 ? 1 : 0);
-				bits += bpp;
+				return id;
 			}
 		}
 
+		return kLayers;
+	}
+
+	bool loadLayer(ui32 id, const char *filename, i32 texture, f32 parallax, ui32 tileSize, const paletteEntry *palette, ui32 paletteCount)
+	{
+		if (id >= kLayers || id == kLayerCollision || paletteCount > SIMD::kMaxPalette)
+		{
+			return false;
+		}
+
+		layer &l = layers[id];
+
+		FIBITMAP *dib = openImage(filename);
+
+		if (!dib)
+		{
+			return false;
+		}
+
+		unloadLayer(id);
+
+		l.width = FreeImage_GetWidth(dib);
+		l.height = FreeImage_GetHeight(dib);
+		l.tileSize = tileSize;
+		l.tiles = new ui8[l.width * l.height];
+
+		decodeImage(dib, palette, paletteCount, l.tiles, l.width);
+
 		FreeImage_Unload(dib);
 
+		showLayer(id, texture, parallax);
+
 		return true;
 	}
 
+	void showLayer(ui32 id, i32 texture, f32 parallax)
+	{
+		layers[id].texture = texture;
+		layers[id].parallax = parallax;
+	}
+
+	void unloadLayer(ui32 id)
+	{
+		layer &l = layers[id];
+
+		if (l.tiles) delete[] l.tiles;
+
+		l.tiles = 0;
+		l.width = l.height = 0;
+		l.revision++;
+	}
+
 	void unload()
 	{
-		if (mapData.data) delete[] mapData.data;
+		if (mapData.memory) delete[] mapData.memory;
+		if (mapData.journal) delete[] mapData.journal;
+
+		if (mapData.rows)
+		{
+			for (ui32 y = 0; y < mapData.height; y++)
+			{
+				delete[] mapData.rows[y].runs;
+			}
+
+			delete[] mapData.rows;
+		}
+
+		mapData.memory = mapData.data = 0;
+		mapData.rows = 0;
+		mapData.journal = 0;
+		mapData.width = mapData.height = mapData.stride = 0;
+	}
+
+	static inline bool solidAt(const pointi &tile)
+	{
+		return (getProperties(clampColumn(tile.x), clampRow(tile.y)) & kSolid) != 0;
+	}
+
+	// share of a segment length long that distance is, or never if that's past its end. Distances are
+	// compared before dividing, like PRJ's slab test, since a 128 pixel tile over a nearly vertical ray is
+	// more than fixed point can hold
+
+	static inline scalar fraction(scalar distance, scalar length, scalar never)
+	{
+		return (distance > length ? never : distance / length);
+	}
+
+	bool raycast(const vectors &start, const vectors &end, hit &result)
+	{
+		const i32 size = mapData.tileSize;
+		const i32 shift = mapData.tileShift;
+		const scalar never = scalar(2); // past the end of the segment
+		const vectors delta(end.x - start.x, end.y - start.y);
+
+		pointi tile(floorToInt(start.x) >> shift, floorToInt(start.y) >> shift);
+
+		if (solidAt(tile))
+		{
+			result.tile = tile;
+			result.point = start;
+			result.normal = pointi(0, 0);
+			result.t = scalar(0);
+
+			return true;
+		}
+
+		// how far along the segment the next vertical and horizontal tile edges are, and how far apart
+
+		const i32 stepX = (delta.x > scalar(0) ? 1 : (delta.x < scalar(0) ? -1 : 0));
+		const i32 stepY = (delta.y > scalar(0) ? 1 : (delta.y < scalar(0) ? -1 : 0));
+
+		scalar nextX = never, nextY = never;
+		scalar spanX = never, spanY = never;
+
+		if (stepX != 0)
+		{
+			spanX = fraction(scalar(size), abs(delta.x), never);
+			nextX = fraction(stepX > 0 ? scalar((tile.x + 1) * size) - start.x : start.x - scalar(tile.x * size), abs(delta.x), never);
+		}
+
+		if (stepY != 0)
+		{
+			spanY = fraction(scalar(size), abs(delta.y), never);
+			nextY = fraction(stepY > 0 ? scalar((tile.y + 1) * size) - start.y : start.y - scalar(tile.y * size), abs(delta.y), never);
+		}
+
+		for (;;)
+		{
+			scalar t;
+			pointi normal(0, 0);
+
+			if (nextX < nextY)
+			{
+				t = nextX;
+				tile.x += stepX;
+				nextX += spanX;
+				normal.x = -stepX;
+			}
+			else
+			{
+				t = nextY;
+				tile.y += stepY;
+				nextY += spanY;
+				normal.y = -stepY;
+			}
+
+			if (t > scalar(1))
+			{
+				return false;
+			}
+
+			if (solidAt(tile))
+			{
+				result.tile = tile;
+				result.point = vectors(start.x + delta.x * t, start.y + delta.y * t);
+				result.normal = normal;
+				result.t = t;
+
+				return true;
+			}
+		}
 	}
 }
@@ -1,36 +1,157 @@
 namespace MAP
 {
+	// A tile is the number of the material it's made of, which indexes materials[]. What the game asks of a
+	// tile goes through its material's property bits, so a query for any set of them is one AND.
+	enum Property
+	{
+		kSolid = 0x01,        // stops boxes and rays
+		kOneWay = 0x02,       // only stops boxes falling onto its top from above
+		kHazard = 0x04,       // hurts whatever touches it
+		kBreakable = 0x08,    // turns into kAir when something digs into it, see PRJ::kFlagDigs
+		kFrictionMask = 0x30  // friction class, see Friction
+	};
+
+	enum Friction { kFrictionNormal = 0x00, kFrictionLow = 0x10, kFrictionHigh = 0x20 };
+
+	enum MaterialId { kAir = 0, kGround, kPlatform, kIce, kSpikes, kBrick };
+
+	const ui32 kMaxMaterials = 256;
+
+	struct material
+	{
+		ui8 properties;
+		ui8 atlasFirst; // where its frames start in the TX::Ground atlas, chooseTile() picks one from there
+	};
+
+	extern material materials[kMaxMaterials];
+
+	// a tile that went from one material to another
+	struct edit
+	{
+		i32 x;
+		i32 y;
+		ui8 before;
+		ui8 after;
+	};
+
+	// edits the journal keeps, a power of two
+	const ui32 kJournalSize = 65536;
+
+	// maps with more tiles than this are kept as runs, see runRow, which hold columns below kMaxRunsWidth
+	const ui32 kRunsThreshold = 1 << 22;
+	const ui32 kMaxRunsWidth = 1 << 24;
+
+	// A row of a map kept as runs instead of a byte per tile, which big maps mostly made of long stretches
+	// of air and ground take a few words a row for. Each run is its first column shifted up by 8 with its
+	// material in the low 8 bits, and lasts until the next one starts or the row ends. The first one starts
+	// at column 0 and no two neighbours are of the same material.
+	struct runRow
+	{
+		ui32 *runs;
+		ui32 count;
+		ui32 capacity;
+	};
+
+	// Tiles are kept with a ring of kGround ones around the map, border tiles wide, so looking at the
+	// neighbours of any tile on the map or at a box that pokes out of it never needs a bounds check. Tile
+	// (x, y) is data[stride * y + x] for x in [-border, width + border) and y in [-border, height + border).
+	//
+	// Every edit after create() bumps the revision by one and goes into the journal, so anything cached at
+	// an earlier revision can catch up by looking at just the tiles that changed since, see journalHas().
+	//
+	// Maps past kRunsThreshold tiles have rows instead, and no grid or border in memory. Everything that
+	// reads tiles through getTile() and collides() sees the same either way.
 	struct mapinfo
 	{
-		ui8 *data;
+		ui8 *memory;    // the whole grid, border included
+		ui8 *data;      // tile (0, 0)
+		runRow *rows;   // height of them when the map is kept as runs, memory and data being 0 then
 		ui32 width;
 		ui32 height;
+		ui32 border;
+		ui32 stride;    // width + 2 * border
 		ui32 tileSize;
+		ui32 tileShift; // tileSize is always 1 << tileShift
+		ui32 revision;  // goes up whenever tiles change, anything cached about them is stale then
+		edit *journal;  // the edit that brought the map to revision r is journal[r % kJournalSize]
+		ui32 journalStart; // revision create() left the map at, the journal has nothing from before it
 
-		mapinfo() : data(0), width(0), height(0), tileSize(32) {}
+		mapinfo() : memory(0), data(0), rows(0), width(0), height(0), border(0), stride(0), tileSize(32), tileShift(5), revision(1),
+			journal(0), journalStart(1) {}
 	};
 
 	extern mapinfo mapData;
 
-	bool load(const char *filename);
-	void unload();
-	inline int getWidth() { return mapData.width; };
-	inline int getHeight() { return mapData.height; };
-	inline int getTileSize() { return mapData.tileSize; };
-	inline int getTile(ui32 x, ui32 y) { return mapData.data[mapData.width * y + x]; };
+	// border for maps that don't ask for one: enough for the 3x3 neighbourhoods drawing looks at, and
+	// for boxes that reach a tile past the edge. Anything further out is clamped into it, see clampColumn()
+	const ui32 kBorder = 2;
+
+	// tile coordinates clamped into the map and its border; everything off the map is solid, so a box or
+	// ray that's further out sees the same as it would at the border
+	inline i32 clampColumn(i32 x)
+	{
+		const i32 border = static_cast<i32>(mapData.border);
+		const i32 last = static_cast<i32>(mapData.width) + border - 1;
+
+		return (x < -border ? -border : (x > last ? last : x));
+	}
+
+	inline i32 clampRow(i32 y)
+	{
+		const i32 border = static_cast<i32>(mapData.border);
+		const i32 last = static_cast<i32>(mapData.height) + border - 1;
+
+		return (y < -border ? -border : (y > last ? last : y));
+	}
+
+	// index of the run covering column x, by binary search: a run starts at or before x exactly when it
+	// sorts before x's column with the highest material
+	inline ui32 runAt(const runRow &row, i32 x)
+	{
+		const ui32 key = (static_cast<ui32>(x) << 8) | 0xFF;
+		ui32 lo = 0, hi = row.count;
+
+		while (hi - lo > 1)
+		{
+			const ui32 mid = (lo + hi) / 2;
+
+			if (row.runs[mid] <= key)
+			{
+				lo = mid;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+
+		return lo;
+	}
 
-	inline bool collides(const recti &rc)
+	// grid::collides for a map kept as runs, with the tiles already worked out and clamped: a search per row
+	// for the first run, then a step per run the span crosses. The border is kGround like a grid's
+	inline bool runsCollide(i32 left, i32 top, i32 right, i32 bottom, ui8 mask)
 	{
-		pointi endpoint(
-			(rc.x + rc.width) / mapData.tileSize,
-			(rc.y + rc.height) / mapData.tileSize
-		);
+		const i32 width = static_cast<i32>(mapData.width);
+		const i32 height = static_cast<i32>(mapData.height);
+
+		if ((left < 0 || top < 0 || right >= width || bottom >= height) && (materials[kGround].properties & mask))
+		{
+			return true;
+		}
 
-		for (i32 y = rc.y / mapData.tileSize; y <= endpoint.y; y++)
+		left = (left > 0 ? left : 0);
+		top = (top > 0 ? top : 0);
+		right = (right < width - 1 ? right : width - 1);
+		bottom = (bottom < height - 1 ? bottom : height - 1);
+
+		for (i32 y = top; y <= bottom; y++)
 		{
-			for (i32 x = rc.x / mapData.tileSize; x <= endpoint.x; x++)
+			const runRow &row = mapData.rows[y];
+
+			for (ui32 k = runAt(row, left); k < row.count && static_cast<i32>(row.runs[k] >> 8) <= right; k++)
 			{
-				if (mapData.data[mapData.width * y + x] && rc.intersects(recti(x * mapData.tileSize, y * mapData.tileSize, mapData.tileSize, mapData.tileSize)))
+				if (materials[row.runs[k] & 0xFF].properties & mask)
 				{
 					return true;
 				}
@@ -39,4 +160,199 @@ namespace MAP
 
 		return false;
 	}
+
+	// tile sizes there's code for, powers of two from 8 to 128 pixels; load() fails on anything else
+	const ui32 kMinTileShift = 3;
+	const ui32 kMaxTileShift = 7;
+	const ui32 kTileShifts = kMaxTileShift - kMinTileShift + 1;
+
+	// The grid math for a tile size fixed at compile time, 1 << Shift pixels, so pixels turn into tiles and
+	// back with shifts and masks instead of dividing. Code that walks tiles in its inner loops is written as
+	// a template on Shift, instantiated for every size in [kMinTileShift, kMaxTileShift], and load() picks
+	// the instantiation that matches the map; tileSlot() is the index into tables of them.
+	template<i32 Shift> struct grid
+	{
+		enum { kShift = Shift, kSize = 1 << Shift, kMask = (1 << Shift) - 1 };
+
+		static inline i32 toTile(i32 pixel) { return pixel >> Shift; }
+		static inline i32 toPixel(i32 tile) { return tile << Shift; }
+		static inline i32 inTile(i32 pixel) { return pixel & kMask; }
+
+		// only looks at the tiles the rectangle covers, its right and bottom edges being exclusive, so any
+		// one with a property in mask is a hit without testing the overlap. Off the map counts as kGround
+		static inline bool collides(const recti &rc, ui8 mask = kSolid)
+		{
+			if (rc.width <= 0 || rc.height <= 0)
+			{
+				return false;
+			}
+
+			const i32 left = clampColumn(toTile(rc.x));
+			const i32 right = clampColumn(toTile(rc.x + rc.width - 1));
+			const i32 top = clampRow(toTile(rc.y));
+			const i32 bottom = clampRow(toTile(rc.y + rc.height - 1));
+
+			if (!mapData.data)
+			{
+				return runsCollide(left, top, right, bottom, mask);
+			}
+
+			for (i32 y = top; y <= bottom; y++)
+			{
+				const ui8 *row = mapData.data + static_cast<i32>(mapData.stride) * y;
+
+				for (i32 x = left; x <= right; x++)
+				{
+					if (materials[row[x]].properties & mask)
+					{
+						return true;
+					}
+				}
+			}
+
+			return false;
+		}
+	};
+
+	typedef bool (*collidesFn)(const recti &rc, ui8 mask);
+
+	// grid<Shift>::collides for the loaded map's tile size
+	extern collidesFn collidesImpl;
+
+	// where a ray stopped, see raycast()
+	struct hit
+	{
+		pointi tile;    // first solid tile on the way
+		vectors point;  // where the ray got into it
+		pointi normal;  // side it got in through, pointing back along the ray, (0, 0) if it started inside
+		scalar t;       // how far from start to end that was, 0 to 1
+	};
+
+	// which material each colour of a map image turns into, colours not in the palette being kAir
+	struct paletteEntry
+	{
+		ui32 color; // 0xRRGGBB
+		ui8 tile;
+	};
+
+	// A map is drawn as a stack of layers, back to front. The collision layer is mapData and is only there
+	// to be drawn if it has a texture; the others are for looks alone, a plain grid of frames of their own
+	// tileset with no border or materials, and nothing in the simulation ever reads them. Their tile v is
+	// frame v - 1, 0 being nothing.
+	enum LayerId { kLayerBackground = 0, kLayerCollision, kLayerForeground, kLayers };
+
+	struct layer
+	{
+		ui8 *tiles;       // width * height row by row, always 0 for kLayerCollision
+		ui32 width;
+		ui32 height;
+		ui32 tileSize;
+		i32 texture;      // TX sprite the frames come from, -1 if the layer isn't drawn
+		f32 parallax;     // pixels it scrolls for each one the camera does, 1 to move with the map
+		ui32 revision;    // goes up whenever tiles change, like mapData.revision
+
+		layer() : tiles(0), width(0), height(0), tileSize(0), texture(-1), parallax(1.0f), revision(1) {}
+	};
+
+	extern layer layers[kLayers];
+
+	// a width by height map of kAir, with a ring of kGround border tiles wide around it, or as runs past
+	// kRunsThreshold tiles. Fails, leaving no map, for runs kMaxRunsWidth or more tiles wide
+	bool create(ui32 width, ui32 height, ui32 border = kBorder);
+
+	// Reads the map from an image, a pixel per tile. Without a palette black pixels are kGround and the rest
+	// are kAir. Scanlines are decoded with SIMD::decodePixels, split across the JOB pool, so it fails for a
+	// palette of more than SIMD::kMaxPalette entries. It also fails for images create() can't make a map of.
+	bool load(const char *filename, ui32 border = kBorder, const paletteEntry *palette = 0, ui32 paletteCount = 0);
+	void unload();
+
+	// "background", "collision" or "foreground", and back; findLayer() gives kLayers for any other name
+	const char *layerName(ui32 id);
+	ui32 findLayer(const char *name);
+
+	// reads a decor layer from an image the way load() reads the map, the palette giving each colour's tile,
+	// and shows it. Fails for kLayerCollision, which is whatever load() read, and for palettes too
+	// big for load()
+	bool loadLayer(ui32 id, const char *filename, i32 texture, f32 parallax, ui32 tileSize, const paletteEntry *palette, ui32 paletteCount);
+	void unloadLayer(ui32 id);
+
+	// sets what a layer is drawn with, a texture of -1 hiding it
+	void showLayer(ui32 id, i32 texture, f32 parallax = 1.0f);
+	inline ui8 getLayerTile(ui32 id, i32 x, i32 y) { return layers[id].tiles[layers[id].width * y + x]; };
+	inline int getWidth() { return mapData.width; };
+	inline int getHeight() { return mapData.height; };
+	inline int getTileSize() { return mapData.tileSize; };
+	inline int getTileShift() { return mapData.tileShift; };
+	inline ui32 tileSlot() { return mapData.tileShift - kMinTileShift; };
+	// any tile on the map or its border. Maps kept as runs search for it, the border being kGround
+	inline int getTile(i32 x, i32 y)
+	{
+		if (mapData.data)
+		{
+			return mapData.data[static_cast<i32>(mapData.stride) * y + x];
+		}
+
+		if (x < 0 || y < 0 || x >= static_cast<i32>(mapData.width) || y >= static_cast<i32>(mapData.height))
+		{
+			return kGround;
+		}
+
+		const runRow &row = mapData.rows[y];
+
+		return row.runs[runAt(row, x)] & 0xFF;
+	};
+	inline ui8 getProperties(i32 x, i32 y) { return materials[getTile(x, y)].properties; };
+
+	// the column past the stretch of tiles of the same material starting at (x, y), on the map. Maps kept
+	// as runs answer with where the next run starts, a grid looks at the tiles one by one
+	inline i32 spanEnd(i32 x, i32 y)
+	{
+		const i32 width = static_cast<i32>(mapData.width);
+
+		if (mapData.data)
+		{
+			const ui8 *row = mapData.data + static_cast<i32>(mapData.stride) * y;
+			const ui8 tile = row[x++];
+
+			while (x < width && row[x] == tile)
+			{
+				x++;
+			}
+
+			return x;
+		}
+
+		const runRow &row = mapData.rows[y];
+		const ui32 k = runAt(row, x) + 1;
+
+		return (k < row.count ? static_cast<i32>(row.runs[k] >> 8) : width);
+	}
+
+	// Changes a tile on the map, the border stays as it is, and journals it. Returns false if the tile is off
+	// the map or already made of that.
+	bool setTile(i32 x, i32 y, ui8 tile);
+
+	// whether every edit since the map was at a revision is still in the journal, editAt(since + 1) to
+	// editAt(mapData.revision)
+	inline bool journalHas(ui32 since)
+	{
+		return since >= mapData.journalStart && since <= mapData.revision && mapData.revision - since <= kJournalSize;
+	}
+
+	inline const edit &editAt(ui32 revision) { return mapData.journal[revision & (kJournalSize - 1)]; }
+
+	// Puts the tiles back the way they were at an earlier revision. It does so by editing them back, so the
+	// revision still goes up and caches catch up as with any other edit. Fails if the journal doesn't go
+	// back that far, or if undoing would write over edits it still has to undo.
+	bool rewind(ui32 revision);
+
+	// Walks the tiles the segment from start to end crosses, one tile edge at a time (Amanatides & Woo), and
+	// stops in the first solid one. Anything off the map counts as solid. Returns false if it gets to end
+	// without hitting anything. Math is in scalar, so rays cast by the simulation stay exact in fixed point.
+	bool raycast(const vectors &start, const vectors &end, hit &result);
+
+	inline bool lineOfSight(const vectors &a, const vectors &b) { hit h; return !raycast(a, b, h); }
+
+	// whether any tile the rectangle covers has a property in mask, see grid::collides
+	inline bool collides(const recti &rc, ui8 mask = kSolid) { return collidesImpl(rc, mask); }
 }
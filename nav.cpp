@@ -0,0 +1,1248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "elementals.h"
+#include "fixed.h"
+#include "map.h"
+#include "collision.h"
+#include "rng.h"
+#include "entities.h"
+#include "projectiles.h"
+#include "sim.h"
+#include "nav.h"
+
+rectf boundingBox(i32 sprite_id, const pointf &pos);
+
+namespace NAV
+{
+	graph navGraph;
+
+	const ui32 kMaxFlightSteps = 400;
+	const ui32 kCacheBits = 16;
+
+	// rectangles a refresh gathers edits into, past that an edit goes into whichever one grows least
+	const ui32 kMaxDirty = 32;
+
+	struct cacheEntry
+	{
+		ui32 from;
+		ui32 goal;
+		ui32 edge;
+		ui32 generation;
+	};
+
+	struct heapItem
+	{
+		ui32 key;
+		ui32 cell;
+		ui32 node;
+	};
+
+	// the character's box relative to its feet, and what the search needs per node
+
+	static recti box;
+	static ui32 walkCost = 0;
+	static ui32 cellCost = 0;
+	static i32 graphSprite = 0;
+
+	// for each node, the tiles its edges could have come out differently for: the ones its box went through
+	// on every move, and far enough around them to take in the cells it could have landed on and whatever
+	// those cells stand on. A tile edited outside them leaves the node's edges as they were. Free slots
+	// have an empty one
+	static recti *nodeReach = 0;
+	static i32 reachMargin = 0;
+
+	// the most tiles any node's reach has gone past its cell on each side, so a refresh only looks through
+	// the rows and columns around an edit
+	static i32 spreadLeft = 0;
+	static i32 spreadUp = 0;
+	static i32 spreadRight = 0;
+	static i32 spreadDown = 0;
+
+	// numbers that can be handed out again, and the ones a refresh gave up, which only join them once it's
+	// over since edges from nodes it hasn't got to yet may still lead there
+	static ui32 *freeSlots = 0;
+	static ui32 freeCount = 0;
+	static ui32 *dropped = 0;
+	static ui32 droppedCount = 0;
+
+	// nodes a refresh finds the edges of again, each once
+	static ui32 *touched = 0;
+	static ui32 touchedCount = 0;
+
+	// route cache entries from an older generation are empty
+	static cacheEntry *cache = 0;
+	static ui32 cacheGeneration = 1;
+
+	static ui32 *searchMark = 0;
+	static ui32 *costSoFar = 0;
+	static ui32 *cameFrom = 0;
+	static ui32 *cameBy = 0;
+	static heapItem *heap = 0;
+	static ui32 heapCapacity = 0;
+	static ui32 searchId = 0;
+
+	// flow fields, the least recently used one goes when another goal comes along
+
+	static ui32 *fieldNext = 0;
+	static ui32 fieldGoal[kFlowFields];
+	static ui32 fieldUsed[kFlowFields];
+	static ui32 fieldClock = 0;
+
+	static bool blocked(i32 x, i32 y)
+	{
+		i32 mapWidth = MAP::getWidth() * MAP::getTileSize();
+		i32 mapHeight = MAP::getHeight() * MAP::getTileSize();
+		recti rc(x + box.x, y + box.y, box.width, box.height);
+
+		if (rc.x < 0 || rc.y < 0 || rc.x + rc.width >= mapWidth || rc.y + rc.height >= mapHeight)
+		{
+			return true;
+		}
+
+		return MAP::collides(rc);
+	}
+
+	// where a column is or would go in a row's nodes
+
+	static inline ui32 rowFind(const nodeRow &row, ui32 cx)
+	{
+		ui32 lo = 0, hi = row.count;
+
+		while (lo < hi)
+		{
+			const ui32 mid = (lo + hi) / 2;
+
+			if (row.nodes[mid].x < cx)
+			{
+				lo = mid + 1;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+
+		return lo;
+	}
+
+	// the node standing in a cell, kNone if there's none
+
+	static inline ui32 nodeIn(ui32 cx, ui32 cy)
+	{
+		const nodeRow &row = navGraph.rows[cy];
+		const ui32 k = rowFind(row, cx);
+
+		return (k < row.count && row.nodes[k].x == cx ? row.nodes[k].node : kNone);
+	}
+
+	static inline i32 feetX(ui32 node)
+	{
+		return navGraph.nodeX[node] * MAP::getTileSize() + MAP::getTileSize() / 2;
+	}
+
+	static inline i32 feetY(ui32 node)
+	{
+		return (navGraph.nodeY[node] + 1) * MAP::getTileSize();
+	}
+
+	// the node under the middle of the feet, or under either end when it's hanging over an edge
+
+	static ui32 nodeAtPixel(i32 x, i32 y)
+	{
+		const i32 shift = MAP::getTileShift();
+		const i32 xs[3] = { x, x - navGraph.halfWidth + 1, x + navGraph.halfWidth - 1 };
+
+		i32 cy = (y - 1) >> shift;
+
+		if (y < 1 || cy >= static_cast<i32>(navGraph.height))
+		{
+			return kNone;
+		}
+
+		for (ui32 k = 0; k < 3; k++)
+		{
+			i32 cx = xs[k] >> shift;
+
+			if (xs[k] >= 0 && cx < static_cast<i32>(navGraph.width))
+			{
+				ui32 node = nodeIn(cx, cy);
+
+				if (node != kNone)
+				{
+					return node;
+				}
+			}
+		}
+
+		return kNone;
+	}
+
+	// moves the box out of a node's cell the way a step would, with the velocity held the whole way,
+	// until it lands. Walking off a ledge keeps going while it's still on the node it left from. Every
+	// position it looks at goes into feet
+
+	static ui32 fly(ui32 node, scalar vx, scalar vy, bool walkOff, ui16 &steps, recti &feet)
+	{
+		scalar x = scalar(feetX(node));
+		scalar y = scalar(feetY(node));
+
+		for (ui32 n = 1; n <= kMaxFlightSteps; n++)
+		{
+			vy += SIM::g * SIM::dt;
+
+			// pressing against a wall on the way up keeps pressing, that's how ledges get climbed
+
+			scalar nx = x + vx * SIM::dt;
+
+			feet.add(recti(floorToInt(nx), floorToInt(y), 1, 1));
+
+			if (!blocked(floorToInt(nx), floorToInt(y)))
+			{
+				x = nx;
+			}
+
+			scalar ny = y + vy * SIM::dt;
+
+			feet.add(recti(floorToInt(x), floorToInt(ny), 1, 1));
+
+			if (!blocked(floorToInt(x), floorToInt(ny)))
+			{
+				y = ny;
+				continue;
+			}
+
+			if (vy < scalar(0))
+			{
+				vy = scalar(0);
+				continue;
+			}
+
+			feet.add(recti(floorToInt(x), ceilToInt(y), 1, 1));
+
+			ui32 landed = nodeAtPixel(floorToInt(x), ceilToInt(y));
+
+			if (landed == node && walkOff)
+			{
+				vy = scalar(0);
+				continue;
+			}
+
+			steps = static_cast<ui16>(n);
+
+			return (landed == node ? kNone : landed);
+		}
+
+		return kNone;
+	}
+
+	// keeps the cheapest way to each neighbour
+
+	static void addEdge(edge *edges, ui32 &count, ui32 from, ui32 to, ui16 cost, Move move, i8 speed)
+	{
+		if (to == kNone || to == from)
+		{
+			return;
+		}
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			if (edges[k].to == to)
+			{
+				if (cost < edges[k].cost)
+				{
+					edges[k].cost = cost;
+					edges[k].move = static_cast<ui8>(move);
+					edges[k].speed = speed;
+				}
+
+				return;
+			}
+		}
+
+		edges[count].from = from;
+		edges[count].to = to;
+		edges[count].cost = cost;
+		edges[count].move = static_cast<ui8>(move);
+		edges[count].speed = speed;
+		count++;
+	}
+
+	// tiles within reachMargin of the box anywhere its feet are in the given pixels, and one pixel lower
+
+	static recti reachOf(const recti &feet)
+	{
+		const i32 shift = MAP::getTileShift();
+		const i32 left = ((feet.x + box.x) >> shift) - reachMargin;
+		const i32 top = ((feet.y + box.y) >> shift) - reachMargin;
+		const i32 right = ((feet.x + feet.width - 1 + box.x + box.width - 1) >> shift) + reachMargin;
+		const i32 bottom = ((feet.y + feet.height - 1 + box.y + box.height) >> shift) + reachMargin;
+
+		return recti(left, top, right - left + 1, bottom - top + 1);
+	}
+
+	// whether a cell is one the box fits in standing on something
+
+	static inline bool standing(ui32 cx, ui32 cy)
+	{
+		const i32 tileSize = MAP::getTileSize();
+		const i32 x = cx * tileSize + tileSize / 2;
+		const i32 y = (cy + 1) * tileSize;
+
+		return !blocked(x, y) && blocked(x, y + 1);
+	}
+
+	// a node's edges, at most kMaxEdgesPerNode of them, and the tiles they depend on
+
+	static ui32 findEdges(ui32 node, edge *edges, recti &reach)
+	{
+		const graph &g = navGraph;
+		ui32 count = 0;
+		recti feet(feetX(node), feetY(node), 1, 1);
+
+		for (i32 dir = -1; dir <= 1; dir += 2)
+		{
+			i32 cx = g.nodeX[node] + dir;
+			ui32 neighbour = (cx >= 0 && cx < static_cast<i32>(g.width) ? nodeIn(cx, g.nodeY[node]) : kNone);
+			ui16 steps = 0;
+
+			// whether there's a node next door decides between walking and falling, either way it counts
+
+			feet.add(recti(feetX(node) + dir * MAP::getTileSize(), feetY(node), 1, 1));
+
+			if (neighbour != kNone)
+			{
+				addEdge(edges, count, node, neighbour, static_cast<ui16>(walkCost), kMoveWalk, static_cast<i8>(4 * dir));
+			}
+			else
+			{
+				ui32 to = fly(node, SIM::kVel * scalar(dir), scalar(0), true, steps, feet);
+				addEdge(edges, count, node, to, steps, kMoveFall, static_cast<i8>(4 * dir));
+			}
+
+			for (ui32 k = 0; k < kJumpSpeedCount; k++)
+			{
+				ui32 to = fly(node, SIM::kVel * scalar(kJumpSpeeds[k] * dir * 0.25f), -SIM::kJump, false, steps, feet);
+				addEdge(edges, count, node, to, steps, kMoveJump, static_cast<i8>(kJumpSpeeds[k] * dir));
+			}
+		}
+
+		reach = reachOf(feet);
+
+		const i32 cx = static_cast<i32>(g.nodeX[node]);
+		const i32 cy = static_cast<i32>(g.nodeY[node]);
+
+		spreadLeft = (cx - reach.x > spreadLeft ? cx - reach.x : spreadLeft);
+		spreadUp = (cy - reach.y > spreadUp ? cy - reach.y : spreadUp);
+		spreadRight = (reach.x + reach.width - 1 - cx > spreadRight ? reach.x + reach.width - 1 - cx : spreadRight);
+		spreadDown = (reach.y + reach.height - 1 - cy > spreadDown ? reach.y + reach.height - 1 - cy : spreadDown);
+
+		return count;
+	}
+
+	// whether a slot has a node in it
+
+	static inline bool live(ui32 node)
+	{
+		return node < navGraph.nodeSlots && nodeReach[node].width > 0;
+	}
+
+	// grows an array to hold capacity items, keeping the first used
+
+	template<typename T> static void resize(T *&items, ui32 used, ui32 capacity)
+	{
+		T *grown = new T[capacity];
+
+		for (ui32 i = 0; i < used; i++)
+		{
+			grown[i] = items[i];
+		}
+
+		delete[] items;
+		items = grown;
+	}
+
+	// makes room for nodes up to capacity, everything per node keeps its place
+
+	static void reserveNodes(ui32 capacity)
+	{
+		graph &g = navGraph;
+		const ui32 slots = g.nodeSlots;
+
+		resize(g.nodeX, slots, capacity);
+		resize(g.nodeY, slots, capacity);
+		resize(g.degree, slots, capacity);
+		resize(g.edges, slots * kMaxEdgesPerNode, capacity * kMaxEdgesPerNode);
+		resize(g.firstIncoming, slots, capacity);
+		resize(g.nextIncoming, slots * kMaxEdgesPerNode, capacity * kMaxEdgesPerNode);
+		resize(nodeReach, slots, capacity);
+		resize(freeSlots, freeCount, capacity);
+		resize(dropped, droppedCount, capacity);
+		resize(touched, touchedCount, capacity);
+		resize(searchMark, slots, capacity);
+		resize(costSoFar, 0, capacity);
+		resize(cameFrom, 0, capacity);
+		resize(cameBy, 0, capacity);
+
+		memset(searchMark + slots, 0, (capacity - slots) * sizeof(ui32));
+
+		// every flow field keeps its own stretch, one longer so there's always one
+
+		ui32 *next = new ui32[kFlowFields * (capacity + 1)];
+
+		for (ui32 k = 0; k < kFlowFields && slots > 0; k++)
+		{
+			memcpy(next + k * (capacity + 1), fieldNext + k * (g.nodeCapacity + 1), slots * sizeof(ui32));
+		}
+
+		delete[] fieldNext;
+		fieldNext = next;
+
+		g.nodeCapacity = capacity;
+	}
+
+	static inline ui32 *field(ui32 k)
+	{
+		return fieldNext + k * (navGraph.nodeCapacity + 1);
+	}
+
+	// a node in a free slot, or a new one, with no edges yet. Flow fields that are kept don't reach it
+
+	static ui32 addNode(ui32 cx, ui32 cy)
+	{
+		graph &g = navGraph;
+		ui32 node;
+
+		if (freeCount > 0)
+		{
+			node = freeSlots[--freeCount];
+		}
+		else
+		{
+			if (g.nodeSlots == g.nodeCapacity)
+			{
+				reserveNodes(g.nodeCapacity > 0 ? 2 * g.nodeCapacity : 64);
+			}
+
+			node = g.nodeSlots++;
+		}
+
+		g.nodeX[node] = cx;
+		g.nodeY[node] = cy;
+		g.degree[node] = 0;
+		g.firstIncoming[node] = kNone;
+		nodeRow &row = g.rows[cy];
+		const ui32 k = rowFind(row, cx);
+
+		if (row.count == row.capacity)
+		{
+			row.capacity = (row.capacity > 0 ? 2 * row.capacity : 4);
+			resize(row.nodes, row.count, row.capacity);
+		}
+
+		memmove(row.nodes + k + 1, row.nodes + k, (row.count - k) * sizeof(rowNode));
+		row.nodes[k].x = cx;
+		row.nodes[k].node = node;
+		row.count++;
+		g.nodeCount++;
+
+		// until its edges are found
+		nodeReach[node] = recti(cx, cy, 1, 1);
+
+		for (ui32 k = 0; k < kFlowFields; k++)
+		{
+			field(k)[node] = kNone;
+		}
+
+		return node;
+	}
+
+	// a node a refresh finds the edges of again, once however many times it's asked
+
+	static inline void touch(ui32 node)
+	{
+		if (searchMark[node] != searchId)
+		{
+			searchMark[node] = searchId;
+			touched[touchedCount++] = node;
+		}
+	}
+
+	// lists a node's edges with the ones leading where they do, or takes them off
+
+	static void linkEdges(ui32 node)
+	{
+		graph &g = navGraph;
+
+		for (ui32 e = node * kMaxEdgesPerNode; e < node * kMaxEdgesPerNode + g.degree[node]; e++)
+		{
+			g.nextIncoming[e] = g.firstIncoming[g.edges[e].to];
+			g.firstIncoming[g.edges[e].to] = e;
+		}
+
+		g.edgeCount += g.degree[node];
+	}
+
+	static void unlinkEdges(ui32 node)
+	{
+		graph &g = navGraph;
+
+		for (ui32 e = node * kMaxEdgesPerNode; e < node * kMaxEdgesPerNode + g.degree[node]; e++)
+		{
+			ui32 *link = &g.firstIncoming[g.edges[e].to];
+
+			while (*link != e)
+			{
+				link = &g.nextIncoming[*link];
+			}
+
+			*link = g.nextIncoming[e];
+		}
+
+		g.edgeCount -= g.degree[node];
+		g.degree[node] = 0;
+	}
+
+	// Forgets flow fields a node's edges changing could change: the ones it was in, and the ones its new
+	// edges lead into. A field it wasn't in had none of its old edges leading anywhere in the field either,
+	// so without new ones that do, searching again would settle the same nodes the same way
+
+	static void dropFields(ui32 node, const edge *edges, ui32 count)
+	{
+		for (ui32 k = 0; k < kFlowFields; k++)
+		{
+			const ui32 goal = fieldGoal[k];
+			const ui32 *next = field(k);
+
+			if (goal == kNone)
+			{
+				continue;
+			}
+
+			bool changed = (node == goal || next[node] != kNone);
+
+			for (ui32 i = 0; i < count && !changed; i++)
+			{
+				changed = (edges[i].to == goal || next[edges[i].to] != kNone);
+			}
+
+			if (changed)
+			{
+				fieldGoal[k] = kNone;
+				fieldUsed[k] = 0;
+			}
+		}
+	}
+
+	// takes a node away, the ones with edges leading to it find theirs again. Its number is given up once
+	// the refresh is over
+
+	static void removeNode(ui32 node)
+	{
+		graph &g = navGraph;
+
+		dropFields(node, 0, 0);
+
+		for (ui32 e = g.firstIncoming[node]; e != kNone; e = g.nextIncoming[e])
+		{
+			touch(e / kMaxEdgesPerNode);
+		}
+
+		unlinkEdges(node);
+
+		nodeRow &row = g.rows[g.nodeY[node]];
+		const ui32 k = rowFind(row, g.nodeX[node]);
+
+		memmove(row.nodes + k, row.nodes + k + 1, (row.count - k - 1) * sizeof(rowNode));
+		row.count--;
+		g.nodeCount--;
+		nodeReach[node] = recti();
+		dropped[droppedCount++] = node;
+	}
+
+	static void nextMark()
+	{
+		if (++searchId == 0)
+		{
+			memset(searchMark, 0, navGraph.nodeCapacity * sizeof(ui32));
+			searchId = 1;
+		}
+	}
+
+	// every improvement goes on the heap, so it needs room for one per edge and a start
+
+	static void growHeap()
+	{
+		const ui32 needed = navGraph.edgeCount + navGraph.nodeSlots + 1;
+
+		if (heapCapacity < needed)
+		{
+			delete[] heap;
+			heapCapacity = needed + needed / 2;
+			heap = new heapItem[heapCapacity];
+		}
+	}
+
+	static void dropRoutes()
+	{
+		if (++cacheGeneration == 0)
+		{
+			memset(cache, 0, (1 << kCacheBits) * sizeof(cacheEntry));
+			cacheGeneration = 1;
+		}
+	}
+
+	// Adds the nodes in a row of cells, numbered left to right. The box is free at the feet of a cell that's
+	// standing and blocked a pixel lower, so on the map that pixel's row of tiles has something solid under
+	// the box. Only the cells over solid stretches of that row are looked at, a stretch at a time, which on
+	// a map kept as runs is a run at a time. Near the bottom edge every cell is
+
+	static void addRow(ui32 cy)
+	{
+		const i32 shift = MAP::getTileShift();
+		const i32 tileSize = MAP::getTileSize();
+		const i32 width = static_cast<i32>(navGraph.width);
+		const i32 below = static_cast<i32>(cy) + 1 + ((box.y + box.height) >> shift);
+
+		if (below < 0 || below + 1 >= static_cast<i32>(navGraph.height))
+		{
+			for (i32 cx = 0; cx < width; cx++)
+			{
+				if (standing(cx, cy))
+				{
+					addNode(cx, cy);
+				}
+			}
+
+			return;
+		}
+
+		// columns before next have been looked at already, stretches of different materials being next to
+		// each other
+
+		i32 next = 0;
+
+		for (i32 x = 0; x < width; )
+		{
+			const i32 end = MAP::spanEnd(x, below);
+
+			if (MAP::getProperties(x, below) & MAP::kSolid)
+			{
+				// the cells whose box at the feet covers any of columns [x, end)
+
+				const i32 left = (x * tileSize - tileSize / 2 - box.x - box.width + tileSize) >> shift;
+				const i32 right = (end * tileSize - tileSize / 2 - box.x - 1) >> shift;
+
+				for (i32 cx = (left > next ? left : next); cx <= right && cx < width; cx++)
+				{
+					if (standing(cx, cy))
+					{
+						addNode(cx, cy);
+					}
+				}
+
+				next = (right + 1 > next ? right + 1 : next);
+			}
+
+			x = end;
+		}
+	}
+
+	bool build(i32 sprite)
+	{
+		release();
+
+		const ui64 width = static_cast<ui32>(MAP::getWidth());
+		const ui64 height = static_cast<ui32>(MAP::getHeight());
+
+		// cells are numbered in a ui32 with kNone left over
+
+		if (width * height >= kNone || width * MAP::getTileSize() > kMaxPixels || height * MAP::getTileSize() > kMaxPixels)
+		{
+			return false;
+		}
+
+		const i32 tileSize = MAP::getTileSize();
+		const f32 speed = toFloat(SIM::kVel) * SIM::kStepTime;
+
+		graphSprite = sprite;
+		box = boundingBox(sprite, pointf(0.0f, 0.0f));
+		walkCost = static_cast<ui32>(ceil(tileSize / speed));
+		cellCost = static_cast<ui32>(tileSize / (2.0f * speed));
+		reachMargin = box.width / tileSize + 2;
+		spreadLeft = spreadUp = spreadRight = spreadDown = 0;
+
+		graph &g = navGraph;
+
+		g.width = MAP::getWidth();
+		g.height = MAP::getHeight();
+		g.halfWidth = box.width / 2;
+		g.revision = MAP::mapData.revision;
+		g.rows = new nodeRow[g.height];
+
+		memset(g.rows, 0, g.height * sizeof(nodeRow));
+
+		for (ui32 cy = 0; cy < g.height; cy++)
+		{
+			addRow(cy);
+		}
+
+		// edges go in their node's slots, and are listed by where they lead once they've all been found
+
+		for (ui32 node = 0; node < g.nodeSlots; node++)
+		{
+			g.degree[node] = static_cast<ui8>(findEdges(node, g.edges + node * kMaxEdgesPerNode, nodeReach[node]));
+		}
+
+		for (ui32 node = 0; node < g.nodeSlots; node++)
+		{
+			linkEdges(node);
+		}
+
+		cache = new cacheEntry[1 << kCacheBits];
+		memset(cache, 0, (1 << kCacheBits) * sizeof(cacheEntry));
+
+		growHeap();
+		clearCache();
+
+		return true;
+	}
+
+	// Gathers the tiles edited since the graph's revision into rectangles. An edit close enough to one to
+	// share most of the nodes it touches goes into it, one further away starts another, and once there are
+	// kMaxDirty of them it goes into whichever grows least
+
+	static ui32 gatherDirty(recti *dirty)
+	{
+		ui32 count = 0;
+
+		for (ui32 r = navGraph.revision + 1; r <= MAP::mapData.revision; r++)
+		{
+			const MAP::edit &e = MAP::editAt(r);
+			const recti tile(e.x, e.y, 1, 1);
+			ui32 into = kNone;
+
+			for (ui32 k = 0; k < count && into == kNone; k++)
+			{
+				const recti near(dirty[k].x - reachMargin, dirty[k].y - reachMargin, dirty[k].width + 2 * reachMargin, dirty[k].height + 2 * reachMargin);
+
+				if (near.intersects(tile))
+				{
+					into = k;
+				}
+			}
+
+			if (into == kNone && count < kMaxDirty)
+			{
+				dirty[count++] = tile;
+				continue;
+			}
+
+			for (ui32 k = 0, least = 0xFFFFFFFF; k < count && into == kNone; k++)
+			{
+				recti grown = dirty[k];
+				grown.add(tile);
+
+				const ui32 growth = static_cast<ui32>(grown.width * grown.height - dirty[k].width * dirty[k].height);
+
+				if (growth < least)
+				{
+					into = k;
+					least = growth;
+				}
+			}
+
+			dirty[into].add(tile);
+		}
+
+		return count;
+	}
+
+	bool refresh()
+	{
+		graph &g = navGraph;
+
+		if (g.width == 0 || g.revision == MAP::mapData.revision)
+		{
+			return false;
+		}
+
+		if (g.width != static_cast<ui32>(MAP::getWidth()) || g.height != static_cast<ui32>(MAP::getHeight()) || !MAP::journalHas(g.revision))
+		{
+			build(graphSprite);
+			return true;
+		}
+
+		recti dirty[kMaxDirty];
+		const ui32 dirtyCount = gatherDirty(dirty);
+		const i32 tileSize = MAP::getTileSize();
+		const i32 width = static_cast<i32>(g.width);
+		const i32 height = static_cast<i32>(g.height);
+
+		// feet further than this many tiles from a tile can't have it in their reach
+
+		const i32 around = reachMargin + (abs(box.x) + abs(box.y) + box.width + box.height) / tileSize + 1;
+
+		nextMark();
+		touchedCount = 0;
+
+		// cells with an edit in their reach might have started or stopped being a node
+
+		for (ui32 d = 0; d < dirtyCount; d++)
+		{
+			const i32 left = (dirty[d].x - around > 0 ? dirty[d].x - around : 0);
+			const i32 top = (dirty[d].y - around > 0 ? dirty[d].y - around : 0);
+			const i32 right = (dirty[d].x + dirty[d].width + around < width ? dirty[d].x + dirty[d].width + around : width);
+			const i32 bottom = (dirty[d].y + dirty[d].height + around < height ? dirty[d].y + dirty[d].height + around : height);
+
+			for (i32 cy = top; cy < bottom; cy++)
+			{
+				for (i32 cx = left; cx < right; cx++)
+				{
+					const recti feet(cx * tileSize + tileSize / 2, (cy + 1) * tileSize, 1, 1);
+
+					if (!reachOf(feet).intersects(dirty[d]))
+					{
+						continue;
+					}
+
+					const ui32 node = nodeIn(cx, cy);
+					const bool stands = standing(cx, cy);
+
+					if (stands && node == kNone)
+					{
+						touch(addNode(cx, cy));
+					}
+					else if (!stands && node != kNone)
+					{
+						removeNode(node);
+					}
+				}
+			}
+		}
+
+		// and nodes with one in theirs might move differently, those can only stand as far from it as reaches spread
+
+		for (ui32 d = 0; d < dirtyCount; d++)
+		{
+			const i32 left = (dirty[d].x - spreadRight > 0 ? dirty[d].x - spreadRight : 0);
+			const i32 top = (dirty[d].y - spreadDown > 0 ? dirty[d].y - spreadDown : 0);
+			const i32 right = (dirty[d].x + dirty[d].width + spreadLeft < width ? dirty[d].x + dirty[d].width + spreadLeft : width);
+			const i32 bottom = (dirty[d].y + dirty[d].height + spreadUp < height ? dirty[d].y + dirty[d].height + spreadUp : height);
+
+			for (i32 cy = top; cy < bottom; cy++)
+			{
+				const nodeRow &row = g.rows[cy];
+
+				for (ui32 k = rowFind(row, left); k < row.count && row.nodes[k].x < static_cast<ui32>(right); k++)
+				{
+					if (nodeReach[row.nodes[k].node].intersects(dirty[d]))
+					{
+						touch(row.nodes[k].node);
+					}
+				}
+			}
+		}
+
+		// their edges are found again in their own slots, and left alone when they come out the same
+
+		for (ui32 t = 0; t < touchedCount; t++)
+		{
+			const ui32 node = touched[t];
+			edge *edges = g.edges + node * kMaxEdgesPerNode;
+			edge found[kMaxEdgesPerNode];
+
+			if (!live(node))
+			{
+				continue;
+			}
+
+			const ui32 count = findEdges(node, found, nodeReach[node]);
+			bool same = (count == g.degree[node]);
+
+			for (ui32 k = 0; k < count && same; k++)
+			{
+				same = (found[k].to == edges[k].to && found[k].cost == edges[k].cost && found[k].move == edges[k].move && found[k].speed == edges[k].speed);
+			}
+
+			if (same)
+			{
+				continue;
+			}
+
+			dropFields(node, found, count);
+			unlinkEdges(node);
+			memcpy(edges, found, count * sizeof(edge));
+			g.degree[node] = static_cast<ui8>(count);
+			linkEdges(node);
+		}
+
+		// nothing leads to the nodes taken away any more
+
+		for (ui32 k = 0; k < droppedCount; k++)
+		{
+			freeSlots[freeCount++] = dropped[k];
+		}
+
+		droppedCount = 0;
+
+		growHeap();
+		dropRoutes();
+
+		g.revision = MAP::mapData.revision;
+
+		return true;
+	}
+
+	void release()
+	{
+		graph &g = navGraph;
+
+		for (ui32 cy = 0; cy < g.height; cy++)
+		{
+			delete[] g.rows[cy].nodes;
+		}
+
+		delete[] g.rows;
+		delete[] g.nodeX;
+		delete[] g.nodeY;
+		delete[] g.degree;
+		delete[] g.edges;
+		delete[] g.firstIncoming;
+		delete[] g.nextIncoming;
+		delete[] nodeReach;
+		delete[] freeSlots;
+		delete[] dropped;
+		delete[] touched;
+		delete[] cache;
+		delete[] searchMark;
+		delete[] costSoFar;
+		delete[] cameFrom;
+		delete[] cameBy;
+		delete[] heap;
+		delete[] fieldNext;
+
+		navGraph = graph();
+		nodeReach = 0;
+		spreadLeft = spreadUp = spreadRight = spreadDown = 0;
+		freeSlots = dropped = touched = 0;
+		freeCount = droppedCount = touchedCount = 0;
+		cache = 0;
+		searchMark = costSoFar = cameFrom = cameBy = 0;
+		heap = 0;
+		heapCapacity = 0;
+		searchId = 0;
+		fieldNext = 0;
+	}
+
+	ui32 cellOf(ui32 node)
+	{
+		return (live(node) ? navGraph.width * navGraph.nodeY[node] + navGraph.nodeX[node] : kNone);
+	}
+
+	ui32 nodeOf(ui32 cell)
+	{
+		return (cell < navGraph.width * navGraph.height ? nodeIn(cell % navGraph.width, cell / navGraph.width) : kNone);
+	}
+
+	ui32 routeOf(ui32 e)
+	{
+		if (e == kNone || e / kMaxEdgesPerNode >= navGraph.nodeSlots)
+		{
+			return kNone;
+		}
+
+		return static_cast<ui32>(navGraph.edges[e].move) << 8 | static_cast<ui8>(navGraph.edges[e].speed);
+	}
+
+	ui32 nodeAt(scalar x, scalar y)
+	{
+		if (navGraph.nodeCount == 0)
+		{
+			return kNone;
+		}
+
+		return nodeAtPixel(floorToInt(x), ceilToInt(y));
+	}
+
+	// binary heap ordered by key, then by cell so equal routes always come out the same however the nodes
+	// are numbered
+
+	static inline bool before(const heapItem &a, const heapItem &b)
+	{
+		return a.key < b.key || (a.key == b.key && a.cell < b.cell);
+	}
+
+	static void push(ui32 &count, ui32 key, ui32 node)
+	{
+		if (count == heapCapacity)
+		{
+			return;
+		}
+
+		ui32 i = count++;
+
+		heap[i].key = key;
+		heap[i].cell = navGraph.width * navGraph.nodeY[node] + navGraph.nodeX[node];
+		heap[i].node = node;
+
+		while (i > 0 && before(heap[i], heap[(i - 1) / 2]))
+		{
+			heapItem t = heap[i];
+			heap[i] = heap[(i - 1) / 2];
+			heap[(i - 1) / 2] = t;
+			i = (i - 1) / 2;
+		}
+	}
+
+	static heapItem pop(ui32 &count)
+	{
+		heapItem top = heap[0];
+		heap[0] = heap[--count];
+
+		for (ui32 i = 0; ; )
+		{
+			ui32 least = i;
+			ui32 l = 2 * i + 1;
+			ui32 r = 2 * i + 2;
+
+			if (l < count && before(heap[l], heap[least])) least = l;
+			if (r < count && before(heap[r], heap[least])) least = r;
+
+			if (least == i)
+			{
+				break;
+			}
+
+			heapItem t = heap[i];
+			heap[i] = heap[least];
+			heap[least] = t;
+			i = least;
+		}
+
+		return top;
+	}
+
+	// nothing moves sideways faster than kVel and landing anywhere in a cell is at most half a cell
+	// off its middle, so half a cell's walk per cell of distance never overestimates
+
+	static inline ui32 estimate(ui32 node, ui32 goal)
+	{
+		i32 dx = static_cast<i32>(navGraph.nodeX[node]) - static_cast<i32>(navGraph.nodeX[goal]);
+
+		return static_cast<ui32>(dx < 0 ? -dx : dx) * cellCost;
+	}
+
+	static bool search(ui32 from, ui32 goal)
+	{
+		const graph &g = navGraph;
+		ui32 heapCount = 0;
+
+		navGraph.searches++;
+
+		nextMark();
+
+		searchMark[from] = searchId;
+		costSoFar[from] = 0;
+		cameFrom[from] = kNone;
+		cameBy[from] = kNone;
+
+		push(heapCount, estimate(from, goal), from);
+
+		// the heap holds every improvement as a new item, items that were improved on since are skipped
+
+		while (heapCount > 0)
+		{
+			heapItem item = pop(heapCount);
+			ui32 node = item.node;
+
+			if (node == goal)
+			{
+				return true;
+			}
+
+			if (item.key != costSoFar[node] + estimate(node, goal))
+			{
+				continue;
+			}
+
+			for (ui32 e = node * kMaxEdgesPerNode; e < node * kMaxEdgesPerNode + g.degree[node]; e++)
+			{
+				ui32 to = g.edges[e].to;
+				ui32 cost = costSoFar[node] + g.edges[e].cost;
+
+				if (searchMark[to] != searchId || cost < costSoFar[to])
+				{
+					searchMark[to] = searchId;
+					costSoFar[to] = cost;
+					cameFrom[to] = node;
+					cameBy[to] = e;
+
+					push(heapCount, cost + estimate(to, goal), to);
+				}
+			}
+		}
+
+		return false;
+	}
+
+	static inline cacheEntry &cached(ui32 from, ui32 goal)
+	{
+		ui32 hash = (from * 0x9E3779B1u) ^ (goal * 0x85EBCA6Bu);
+
+		return cache[hash >> (32 - kCacheBits)];
+	}
+
+	ui32 next(ui32 from, ui32 goal)
+	{
+		if (!live(from) || !live(goal) || from == goal)
+		{
+			return kNone;
+		}
+
+		navGraph.queries++;
+
+		cacheEntry &entry = cached(from, goal);
+
+		if (entry.generation != cacheGeneration || entry.from != from || entry.goal != goal)
+		{
+			entry.from = from;
+			entry.goal = goal;
+			entry.edge = kNone;
+			entry.generation = cacheGeneration;
+
+			if (search(from, goal))
+			{
+				for (ui32 node = goal; node != from; node = cameFrom[node])
+				{
+					entry.edge = cameBy[node];
+				}
+			}
+		}
+
+		return entry.edge;
+	}
+
+	ui32 findPath(ui32 from, ui32 goal, ui32 *route, ui32 capacity)
+	{
+		if (!live(from) || !live(goal) || from == goal || !search(from, goal))
+		{
+			return 0;
+		}
+
+		ui32 count = 0;
+
+		for (ui32 node = goal; node != from; node = cameFrom[node])
+		{
+			count++;
+		}
+
+		if (count > capacity)
+		{
+			return 0;
+		}
+
+		ui32 k = count;
+
+		for (ui32 node = goal; node != from; node = cameFrom[node])
+		{
+			route[--k] = cameBy[node];
+		}
+
+		return count;
+	}
+
+	// dijkstra backwards from the goal, every node that gets settled knows its first move
+
+	static void buildField(ui32 *next, ui32 goal)
+	{
+		const graph &g = navGraph;
+		ui32 heapCount = 0;
+
+		navGraph.fields++;
+
+		nextMark();
+
+		for (ui32 node = 0; node < g.nodeSlots; node++)
+		{
+			next[node] = kNone;
+		}
+
+		searchMark[goal] = searchId;
+		costSoFar[goal] = 0;
+
+		push(heapCount, 0, goal);
+
+		while (heapCount > 0)
+		{
+			heapItem item = pop(heapCount);
+			ui32 node = item.node;
+
+			if (item.key != costSoFar[node])
+			{
+				continue;
+			}
+
+			for (ui32 e = g.firstIncoming[node]; e != kNone; e = g.nextIncoming[e])
+			{
+				ui32 from = g.edges[e].from;
+				ui32 cost = costSoFar[node] + g.edges[e].cost;
+
+				if (searchMark[from] != searchId || cost < costSoFar[from])
+				{
+					searchMark[from] = searchId;
+					costSoFar[from] = cost;
+					next[from] = e;
+
+					push(heapCount, cost, from);
+				}
+			}
+		}
+	}
+
+	const ui32 *flow(ui32 goal)
+	{
+		if (!live(goal))
+		{
+			return 0;
+		}
+
+		ui32 slot = 0;
+
+		for (ui32 k = 0; k < kFlowFields; k++)
+		{
+			if (fieldGoal[k] == goal)
+			{
+				fieldUsed[k] = ++fieldClock;
+				return field(k);
+			}
+
+			if (fieldUsed[k] < fieldUsed[slot])
+			{
+				slot = k;
+			}
+		}
+
+		ui32 *next = field(slot);
+
+		buildField(next, goal);
+		fieldGoal[slot] = goal;
+		fieldUsed[slot] = ++fieldClock;
+
+		return next;
+	}
+
+	void clearCache()
+	{
+		for (ui32 k = 0; k < kFlowFields; k++)
+		{
+			fieldGoal[k] = kNone;
+			fieldUsed[k] = 0;
+		}
+
+		if (cache)
+		{
+			dropRoutes();
+		}
+	}
+}
@@ -0,0 +1,127 @@
+// NAV stands for navigation. Cells a character can stand in are nodes, moves
+// between them are edges, and routes come from A* or a flow field per goal.
+
+namespace NAV
+{
+	const ui32 kNone = 0xFFFFFFFF;
+
+	// goals whose flow fields are kept around at once, one per player is plenty
+	const ui32 kFlowFields = 4;
+
+	// feet are worked out in i32 pixels, this leaves room for boxes and flights past the map's edges
+	const ui32 kMaxPixels = 1 << 30;
+
+	// jumps are tried at full, half and a quarter of the walking speed, in quarters of kVel
+	const i8 kJumpSpeeds[] = { 4, 2, 1 };
+	const ui32 kJumpSpeedCount = sizeof(kJumpSpeeds) / sizeof(kJumpSpeeds[0]);
+
+	// a walk or fall and a jump per speed, each way
+	const ui32 kMaxEdgesPerNode = 2 + 2 * (1 + kJumpSpeedCount);
+
+	enum Move { kMoveWalk = 0, kMoveFall, kMoveJump };
+
+	struct edge
+	{
+		ui32 from;
+		ui32 to;
+		ui16 cost;  // in steps
+		ui8 move;
+		i8 speed;   // horizontal velocity while moving, in quarters of SIM::kVel
+	};
+
+	// the nodes standing in a row of cells, by column, for finding the one in a cell with a binary search
+	struct rowNode
+	{
+		ui32 x;
+		ui32 node;
+	};
+
+	struct nodeRow
+	{
+		rowNode *nodes;
+		ui32 count;
+		ui32 capacity;
+	};
+
+	struct graph
+	{
+		// map cells, in tiles, and the nodes in each row of them
+
+		ui32 width;
+		ui32 height;
+		nodeRow *rows;
+
+		// nodes keep their number until an edit takes them away, slots below nodeSlots can be free
+
+		ui32 nodeCount;
+		ui32 nodeSlots;
+		ui32 nodeCapacity;
+		ui32 *nodeX;
+		ui32 *nodeY;
+
+		// edge e leaves node e / kMaxEdgesPerNode, the first degree[node] of a node's slots are used
+
+		ui8 *degree;
+		edge *edges;
+		ui32 edgeCount;
+
+		// the same edges listed by the node they lead to, kNone ends each list
+
+		ui32 *firstIncoming;
+		ui32 *nextIncoming;
+
+		// half the width of the box the graph was built for, to find the node under its feet
+
+		i32 halfWidth;
+
+		// MAP revision the graph is up to date with
+
+		ui32 revision;
+
+		// counters for reports
+
+		ui32 queries;
+		ui32 searches;
+		ui32 fields;
+
+		graph() : width(0), height(0), rows(0), nodeCount(0), nodeSlots(0), nodeCapacity(0), nodeX(0), nodeY(0),
+			degree(0), edges(0), edgeCount(0), firstIncoming(0), nextIncoming(0), halfWidth(0), revision(0), queries(0),
+			searches(0), fields(0) {}
+	};
+
+	extern graph navGraph;
+
+	// Builds the graph over MAP::mapData for characters with the given sprite's bounding box. Fails, leaving
+	// no graph, on maps with more cells than fit in a ui32 or more pixels a side than kMaxPixels.
+	bool build(i32 sprite);
+	void release();
+
+	// catches the graph up with the map's edits, only looking again at nodes near them; false if there were none
+	bool refresh();
+
+	// node whose cell the feet at (x, y) are standing in, kNone in the air
+	ui32 nodeAt(scalar x, scalar y);
+
+	// the cell a node stands in as width * y + x, and back; kNone for kNone or a cell with no node in it.
+	// Node numbers depend on the edits the graph went through, what's kept between steps should be cells
+	ui32 cellOf(ui32 node);
+	ui32 nodeOf(ui32 cell);
+
+	// an edge's move and speed as move << 8 | speed, kNone for kNone; see routeMove() and routeSpeed()
+	ui32 routeOf(ui32 edge);
+	inline ui8 routeMove(ui32 route) { return static_cast<ui8>(route >> 8); }
+	inline i8 routeSpeed(ui32 route) { return static_cast<i8>(route & 0xFF); }
+
+	// first edge of the shortest route from one node to another, kNone if there's none or from == goal
+	ui32 next(ui32 from, ui32 goal);
+
+	// the whole route as edge indices, returns how many there are or 0 if there's none or it doesn't fit
+	ui32 findPath(ui32 from, ui32 goal, ui32 *route, ui32 capacity);
+
+	// first edge towards the goal for every node, kNone where there's no way or at the goal itself. A field
+	// is only rebuilt when its goal moves to another node or an edit could have changed it, and stays
+	// valid until kFlowFields other goals have been asked for or the graph is next refreshed
+	const ui32 *flow(ui32 goal);
+
+	void clearCache();
+}
@@ -8,6 +8,7 @@
 namespace GFX
 {
 	GLuint textures[TX::MAX] = {0};
+	bool initialized = false;
 
 	bool init(const char *title, sizei resolution, bool fullscreen)
 	{
@@ -41,6 +42,8 @@ namespace GFX
 		glEnable(GL_BLEND);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+		initialized = true;
+
 		return true;
 	}
 
@@ -63,12 +66,17 @@ namespace GFX
 		}
 
 		glfwTerminate();
+
+		initialized = false;
 	}
 
 	void loadTexture(int id, int width, int height, void *bits, bool repeat)
 	{
 		GLuint &tx = textures[id];
 
+		// headless runs load images without a context, there's nothing to upload to
+		if (!initialized) return;
+
 		if (tx) unloadTexture(id);
 
 		glGenTextures(1, &tx);
@@ -82,7 +90,7 @@ namespace GFX
 
 	void unloadTexture(int id)
 	{
-		if (textures[id])
+		if (initialized && textures[id])
 		{
 			glDeleteTextures(1, &(textures[id]));
 			textures[id] = 0;
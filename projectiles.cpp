@@ -0,0 +1,423 @@
+#include "elementals.h"
+#include "fixed.h"
+#include "map.h"
+#include "projectiles.h"
+
+namespace PRJ
+{
+	// how far off a tile a bouncing projectile is put back, so its next ray doesn't start inside it
+	static const scalar kSkin = scalar(1.0f / 64.0f);
+
+	// share of the speed into a tile that's kept when bouncing off it
+	static const scalar kRestitution = scalar(0.5f);
+
+	void reset(store &s)
+	{
+		s.count = 0;
+	}
+
+	bool spawn(store &s, vectors position, vectors velocity, scalar life, ui8 size, ui8 flags, ui32 owner)
+	{
+		if (s.count >= kMaxProjectiles)
+		{
+			return false;
+		}
+
+		ui32 i = s.count++;
+
+		s.posX[i] = s.prevX[i] = position.x;
+		s.posY[i] = s.prevY[i] = position.y;
+		s.velX[i] = velocity.x;
+		s.velY[i] = velocity.y;
+		s.life[i] = life;
+		s.size[i] = (size > kMaxSize ? kMaxSize : size);
+		s.flags[i] = flags;
+		s.owner[i] = owner;
+		s.hit[i] = kNone;
+
+		return true;
+	}
+
+	void despawn(store &s, ui32 i)
+	{
+		ui32 last = --s.count;
+
+		if (i == last)
+		{
+			return;
+		}
+
+		s.posX[i] = s.posX[last];
+		s.posY[i] = s.posY[last];
+		s.prevX[i] = s.prevX[last];
+		s.prevY[i] = s.prevY[last];
+		s.velX[i] = s.velX[last];
+		s.velY[i] = s.velY[last];
+		s.life[i] = s.life[last];
+		s.size[i] = s.size[last];
+		s.flags[i] = s.flags[last];
+		s.owner[i] = s.owner[last];
+		s.hit[i] = s.hit[last];
+	}
+
+	void clear(targets &t)
+	{
+		t.count = 0;
+	}
+
+	void add(targets &t, const rects &box, ui32 id)
+	{
+		if (t.count >= kMaxTargets)
+		{
+			return;
+		}
+
+		t.box[t.count] = box;
+		t.id[t.count] = id;
+		t.count++;
+	}
+
+	// cell along one axis, anything off the grid going into the nearest one
+
+	static inline i32 cell(scalar v, i32 shift, i32 count)
+	{
+		i32 c = floorToInt(v) >> shift;
+
+		if (c < 0)
+		{
+			return 0;
+		}
+
+		return (c >= count ? count - 1 : c);
+	}
+
+	static inline ui32 cellOf(const targets &t, const rects &box)
+	{
+		return static_cast<ui32>(cell(box.y, t.cellShift, t.rows) * t.columns + cell(box.x, t.cellShift, t.columns));
+	}
+
+	// counting sort by cell, going backwards so each cell keeps the order targets were added in
+
+	void sort(targets &t)
+	{
+		const i32 width = MAP::getWidth() * MAP::getTileSize();
+		const i32 height = MAP::getHeight() * MAP::getTileSize();
+
+		t.cellShift = kTargetCellShift;
+		t.columns = (width >> t.cellShift) + 1;
+		t.rows = (height >> t.cellShift) + 1;
+
+		while (static_cast<ui32>(t.columns * t.rows) > kMaxCells)
+		{
+			t.cellShift++;
+			t.columns = (width >> t.cellShift) + 1;
+			t.rows = (height >> t.cellShift) + 1;
+		}
+
+		const ui32 cells = static_cast<ui32>(t.columns * t.rows);
+
+		for (ui32 c = 0; c <= cells; c++)
+		{
+			t.first[c] = 0;
+		}
+
+		t.widest = t.tallest = scalar(0);
+
+		for (ui32 i = 0; i < t.count; i++)
+		{
+			t.first[cellOf(t, t.box[i])]++;
+
+			if (t.box[i].width > t.widest) t.widest = t.box[i].width;
+			if (t.box[i].height > t.tallest) t.tallest = t.box[i].height;
+		}
+
+		for (ui32 c = 1; c <= cells; c++)
+		{
+			t.first[c] += t.first[c - 1];
+		}
+
+		for (ui32 i = t.count; i-- > 0;)
+		{
+			t.order[--t.first[cellOf(t, t.box[i])]] = i;
+		}
+	}
+
+	// narrows [enter, leave] down to the part of the segment within [lo, hi) along one axis. Distances are
+	// compared before dividing so the fraction never goes past 1, which fixed point couldn't hold for
+	// a slow projectile and a far slab
+
+	static inline bool slab(scalar start, scalar delta, scalar lo, scalar hi, scalar &enter, scalar &leave)
+	{
+		if (delta == scalar(0))
+		{
+			return start >= lo && start < hi;
+		}
+
+		scalar toEnter, toLeave, length;
+
+		if (delta > scalar(0))
+		{
+			toEnter = lo - start;
+			toLeave = hi - start;
+			length = delta;
+		}
+		else
+		{
+			toEnter = start - hi;
+			toLeave = start - lo;
+			length = -delta;
+		}
+
+		if (toLeave <= scalar(0) || toEnter > length)
+		{
+			return false;
+		}
+
+		if (toEnter > scalar(0))
+		{
+			scalar t = toEnter / length;
+			if (t > enter) enter = t;
+		}
+
+		if (toLeave < length)
+		{
+			scalar t = toLeave / length;
+			if (t < leave) leave = t;
+		}
+
+		return enter < leave;
+	}
+
+	// earliest target the square of half side size crosses on its way from start along delta, no later than
+	// limit. Returns its index or kNone
+
+	static ui32 sweepTargets(const targets &t, vectors start, vectors delta, scalar size, ui32 owner, scalar &limit)
+	{
+		if (t.count == 0)
+		{
+			return kNone;
+		}
+
+		const scalar minX = (delta.x < scalar(0) ? start.x + delta.x : start.x) - size;
+		const scalar maxX = (delta.x < scalar(0) ? start.x : start.x + delta.x) + size;
+		const scalar minY = (delta.y < scalar(0) ? start.y + delta.y : start.y) - size;
+		const scalar maxY = (delta.y < scalar(0) ? start.y : start.y + delta.y) + size;
+
+		// a target can only reach in from as far left as the widest one is wide, and as far up as the tallest
+		// one is tall
+
+		const i32 left = cell(minX - t.widest, t.cellShift, t.columns);
+		const i32 right = cell(maxX, t.cellShift, t.columns);
+		const i32 top = cell(minY - t.tallest, t.cellShift, t.rows);
+		const i32 bottom = cell(maxY, t.cellShift, t.rows);
+
+		ui32 best = kNone;
+
+		for (i32 row = top; row <= bottom; row++)
+		{
+			const ui32 end = t.first[row * t.columns + right + 1];
+
+			for (ui32 k = t.first[row * t.columns + left]; k < end; k++)
+			{
+				const ui32 i = t.order[k];
+				const rects &box = t.box[i];
+
+				if (t.id[i] == owner || box.x >= maxX || box.x + box.width <= minX || box.y >= maxY || box.y + box.height <= minY)
+				{
+					continue;
+				}
+
+				scalar enter = scalar(0), leave = limit;
+
+				if (slab(start.x, delta.x, box.x - size, box.x + box.width + size, enter, leave) &&
+					slab(start.y, delta.y, box.y - size, box.y + box.height + size, enter, leave))
+				{
+					limit = enter;
+					best = i;
+				}
+			}
+		}
+
+		return best;
+	}
+
+	// earliest tile the square crosses into. A point is a single ray, a square casts one from each corner on
+	// its leading sides, up to three of them, which can't miss a tile as long as the square is no wider
+	// than one. Corners on the far sides sit just inside the square, its right and bottom edges being
+	// exclusive like the map's
+
+	static bool sweepTiles(vectors start, vectors delta, scalar size, MAP::hit &result)
+	{
+		// most steps are a few pixels through open space, a free box around the whole sweep settles them
+		// without casting anything. It reaches a pixel further up and left, since a ray going that way
+		// counts ending right on a tile's edge as getting into it
+
+		const i32 left = floorToInt((delta.x < scalar(0) ? start.x + delta.x : start.x) - size) - 1;
+		const i32 top = floorToInt((delta.y < scalar(0) ? start.y + delta.y : start.y) - size) - 1;
+		const i32 right = floorToInt((delta.x < scalar(0) ? start.x : start.x + delta.x) + size) + 1;
+		const i32 bottom = floorToInt((delta.y < scalar(0) ? start.y : start.y + delta.y) + size) + 1;
+
+		if (!MAP::collides(recti(left, top, right - left, bottom - top)))
+		{
+			return false;
+		}
+
+		if (size == scalar(0))
+		{
+			return MAP::raycast(start, vectors(start.x + delta.x, start.y + delta.y), result);
+		}
+
+		const scalar low = -size;
+		const scalar high = size - kSkin;
+
+		vectors corners[3];
+		ui32 cornerCount = 0;
+
+		const scalar leadX = (delta.x > scalar(0) ? high : low);
+		const scalar leadY = (delta.y > scalar(0) ? high : low);
+
+		if (delta.x != scalar(0))
+		{
+			corners[cornerCount++] = vectors(leadX, low == leadY ? high : low);
+		}
+
+		if (delta.y != scalar(0))
+		{
+			corners[cornerCount++] = vectors(leadX == low ? high : low, leadY);
+		}
+
+		corners[cornerCount++] = vectors(leadX, leadY);
+
+		bool blocked = false;
+
+		for (ui32 c = 0; c < cornerCount; c++)
+		{
+			const vectors from(start.x + corners[c].x, start.y + corners[c].y);
+			MAP::hit h;
+
+			if (MAP::raycast(from, vectors(from.x + delta.x, from.y + delta.y), h) && (!blocked || h.t < result.t))
+			{
+				result = h;
+				blocked = true;
+			}
+		}
+
+		if (blocked)
+		{
+			result.point = vectors(start.x + delta.x * result.t, start.y + delta.y * result.t);
+		}
+
+		return blocked;
+	}
+
+	ui32 update(store &s, const targets *t, scalar dt, scalar gravity)
+	{
+		ui32 dug = 0;
+
+		for (ui32 i = 0; i < s.count; i++)
+		{
+			s.hit[i] = kNone;
+			s.prevX[i] = s.posX[i];
+			s.prevY[i] = s.posY[i];
+
+			if (s.life[i] <= dt)
+			{
+				s.life[i] = scalar(0);
+				continue;
+			}
+
+			s.life[i] -= dt;
+
+			if (s.flags[i] & kFlagGravity)
+			{
+				s.velY[i] += gravity * dt;
+			}
+
+			const vectors start(s.posX[i], s.posY[i]);
+			const vectors delta(s.velX[i] * dt, s.velY[i] * dt);
+			const scalar size = scalar(static_cast<i32>(s.size[i]));
+
+			if (delta.x == scalar(0) && delta.y == scalar(0))
+			{
+				continue;
+			}
+
+			MAP::hit wall;
+			const bool blocked = sweepTiles(start, delta, size, wall);
+			scalar limit = (blocked ? wall.t : scalar(1));
+
+			// a target only counts if it's reached before the wall is
+
+			ui32 target = kNone;
+
+			if (t && (s.flags[i] & kFlagHitsCharacters))
+			{
+				target = sweepTargets(*t, start, delta, size, s.owner[i], limit);
+			}
+
+			if (target != kNone)
+			{
+				s.posX[i] = start.x + delta.x * limit;
+				s.posY[i] = start.y + delta.y * limit;
+				s.hit[i] = t->id[target];
+				s.life[i] = scalar(0);
+			}
+			else if (blocked)
+			{
+				const bool digs = (s.flags[i] & kFlagDigs) && (MAP::getProperties(MAP::clampColumn(wall.tile.x), MAP::clampRow(wall.tile.y)) & MAP::kBreakable);
+
+				if (digs && MAP::setTile(wall.tile.x, wall.tile.y, MAP::kAir))
+				{
+					dug++;
+				}
+
+				// started inside a tile, there's no side to bounce off
+
+				if (digs || !(s.flags[i] & kFlagBounce) || (wall.normal.x == 0 && wall.normal.y == 0))
+				{
+					s.posX[i] = wall.point.x;
+					s.posY[i] = wall.point.y;
+					s.life[i] = scalar(0);
+					continue;
+				}
+
+				s.posX[i] = wall.point.x + kSkin * scalar(wall.normal.x);
+				s.posY[i] = wall.point.y + kSkin * scalar(wall.normal.y);
+
+				if (wall.normal.x != 0)
+				{
+					s.velX[i] = -s.velX[i] * kRestitution;
+				}
+
+				if (wall.normal.y != 0)
+				{
+					s.velY[i] = -s.velY[i] * kRestitution;
+				}
+			}
+			else
+			{
+				s.posX[i] = start.x + delta.x;
+				s.posY[i] = start.y + delta.y;
+			}
+		}
+
+		return dug;
+	}
+
+	void removeDead(store &s)
+	{
+		ui32 i = 0;
+
+		while (i < s.count)
+		{
+			if (s.life[i] == scalar(0))
+			{
+				despawn(s, i);
+			}
+			else
+			{
+				i++;
+			}
+		}
+	}
+}
@@ -0,0 +1,89 @@
+// PRJ stands for projectiles. They're too fast and too many to go through
+// the pixel by pixel walk characters use, so each step a projectile sweeps
+// the segment it moves along through the map with MAP::raycast and through
+// the boxes of whatever it can hit, and stops at whichever comes first.
+// Projectiles are either points or small squares; a square is swept as
+// rays from its leading corners, which is exact as long as it's no bigger
+// than a tile.
+//
+// Like ENT, live projectiles are packed in [0, count) and every field is an
+// array of its own. There are no handles, removing one moves the last one
+// into its place.
+
+namespace PRJ
+{
+	const ui32 kMaxProjectiles = 16384;
+	const ui32 kNone = 0xFFFFFFFF;
+
+	// half the side of the biggest square, so it's never wider than a tile
+	const ui8 kMaxSize = 16;
+
+	enum Flags
+	{
+		kFlagGravity = 0x01,        // falls like characters do
+		kFlagBounce = 0x02,         // bounces off tiles instead of stopping at them
+		kFlagHitsCharacters = 0x04, // checked against the targets passed to update()
+		kFlagDigs = 0x08            // breaks MAP::kBreakable tiles it runs into, and stops there
+	};
+
+	struct store
+	{
+		ui32 count;
+
+		scalar posX[kMaxProjectiles];
+		scalar posY[kMaxProjectiles];
+		scalar prevX[kMaxProjectiles];
+		scalar prevY[kMaxProjectiles];
+		scalar velX[kMaxProjectiles];
+		scalar velY[kMaxProjectiles];
+		scalar life[kMaxProjectiles];  // seconds left, gone once it's 0
+		ui8 size[kMaxProjectiles];     // half the side of its square, 0 for a point
+		ui8 flags[kMaxProjectiles];
+		ui32 owner[kMaxProjectiles];   // id of the target that threw it, it never hits that one
+		ui32 hit[kMaxProjectiles];     // id of the target it hit in the last update, kNone if none
+	};
+
+	// boxes projectiles can hit besides the map, each with an id that comes back in store::hit. They're
+	// bucketed on a grid over the map by the cell their top left corner is in, so a projectile only looks
+	// at the ones around it. Cells start at 1 << kTargetCellShift pixels and double until the grid fits in
+	// kMaxCells
+	const ui32 kMaxTargets = 8192;
+	const i32 kTargetCellShift = 5;
+	const ui32 kMaxCells = 65536;
+
+	struct targets
+	{
+		ui32 count;
+		rects box[kMaxTargets];
+		ui32 id[kMaxTargets];
+
+		// filled in by sort(): target indices grouped by cell row by row, where each cell starts, and how
+		// far a box can reach out of its cell
+
+		i32 cellShift;
+		i32 columns;
+		i32 rows;
+		ui32 order[kMaxTargets];
+		ui32 first[kMaxCells + 1];
+		scalar widest;
+		scalar tallest;
+	};
+
+	void reset(store &s);
+
+	// false if the store is full
+	bool spawn(store &s, vectors position, vectors velocity, scalar life, ui8 size, ui8 flags, ui32 owner = kNone);
+
+	// moves the last projectile into i
+	void despawn(store &s, ui32 i);
+
+	void clear(targets &t);
+	void add(targets &t, const rects &box, ui32 id);
+	void sort(targets &t);
+
+	// moves every projectile one step. The ones that hit a tile without bouncing, hit a target or run out
+	// of life are left with life 0 for the caller to look at, and go away on the next removeDead(). Returns
+	// how many tiles were dug out, in projectile order so every run digs the same ones
+	ui32 update(store &s, const targets *t, scalar dt, scalar gravity);
+	void removeDead(store &s);
+}
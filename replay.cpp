@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "elementals.h"
+#include "fixed.h"
+#include "collision.h"
+#include "rng.h"
+#include "entities.h"
+#include "projectiles.h"
+#include "sim.h"
+#include "replay.h"
+
+namespace REC
+{
+	struct fileHeader
+	{
+		ui32 magic;
+		ui32 version;
+		ui32 seed;
+		ui32 characters;
+		ui32 chasers;
+		i32 viewWidth;
+		i32 viewHeight;
+		ui32 lod;
+		ui32 steps;
+	};
+
+	void begin(recording &r, ui32 seed, ui32 characters, ui32 chasers, sizei viewSize, bool lod)
+	{
+		release(r);
+
+		r.seed = seed;
+		r.characters = characters;
+		r.chasers = chasers;
+		r.viewSize = viewSize;
+		r.lod = lod;
+	}
+
+	void record(recording &r, SIM::input in)
+	{
+		if (r.steps == r.capacity)
+		{
+			// an hour of play is a few hundred kilobytes, doubling keeps this off the step's back
+
+			ui32 capacity = (r.capacity > 0 ? r.capacity * 2 : 4096);
+			SIM::input *inputs = new SIM::input[capacity];
+
+			if (r.steps > 0)
+			{
+				memcpy(inputs, r.inputs, r.steps * sizeof(SIM::input));
+			}
+
+			delete[] r.inputs;
+
+			r.inputs = inputs;
+			r.capacity = capacity;
+		}
+
+		r.inputs[r.steps++] = in;
+	}
+
+	bool save(const recording &r, const char *filename)
+	{
+		FILE *file = fopen(filename, "wb");
+
+		if (!file)
+		{
+			return false;
+		}
+
+		fileHeader header;
+		header.magic = kMagic;
+		header.version = kVersion;
+		header.seed = r.seed;
+		header.characters = r.characters;
+		header.chasers = r.chasers;
+		header.viewWidth = r.viewSize.width;
+		header.viewHeight = r.viewSize.height;
+		header.lod = (r.lod ? 1 : 0);
+		header.steps = r.steps;
+
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+		for (ui32 i = 0; ok && i < r.steps; )
+		{
+			ui32 length = 1;
+
+			while (i + length < r.steps && length < 0xFFFF && r.inputs[i + length] == r.inputs[i])
+			{
+				length++;
+			}
+
+			ui8 run[3] = { r.inputs[i], static_cast<ui8>(length & 0xFF), static_cast<ui8>(length >> 8) };
+
+			ok = fwrite(run, sizeof(run), 1, file) == 1;
+			i += length;
+		}
+
+		return (fclose(file) == 0) && ok;
+	}
+
+	bool load(recording &r, const char *filename)
+	{
+		release(r);
+
+		FILE *file = fopen(filename, "rb");
+
+		if (!file)
+		{
+			return false;
+		}
+
+		fileHeader header;
+
+		if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != kMagic || header.version != kVersion)
+		{
+			fclose(file);
+			return false;
+		}
+
+		r.seed = header.seed;
+		r.characters = header.characters;
+		r.chasers = header.chasers;
+		r.viewSize = sizei(header.viewWidth, header.viewHeight);
+		r.lod = (header.lod != 0);
+		r.inputs = new SIM::input[header.steps > 0 ? header.steps : 1];
+		r.capacity = header.steps;
+
+		while (r.steps < header.steps)
+		{
+			ui8 run[3];
+
+			if (fread(run, sizeof(run), 1, file) != 1)
+			{
+				break;
+			}
+
+			ui32 length = run[1] | (run[2] << 8);
+
+			if (length == 0 || length > header.steps - r.steps)
+			{
+				break;
+			}
+
+			memset(r.inputs + r.steps, run[0], length);
+			r.steps += length;
+		}
+
+		fclose(file);
+
+		if (r.steps != header.steps)
+		{
+			release(r);
+			return false;
+		}
+
+		return true;
+	}
+
+	void release(recording &r)
+	{
+		delete[] r.inputs;
+
+		r.inputs = 0;
+		r.steps = 0;
+		r.capacity = 0;
+	}
+}
@@ -0,0 +1,37 @@
+// REC stands for recording. A session is its seed, the crowd sizes, the view
+// size it started with, whether far entities ran at a reduced rate (see
+// SIM::world::lod) and one input bitmask per step. Feeding the same
+// inputs to a world set up the same way gives the same run again, so logs
+// double as benchmark workloads. Window resizes aren't recorded, they don't
+// need to be: the world keeps the view size it was set up with, see
+// SIM::world::viewSize, and a resized window only shows more or less of it.
+//
+// On disk it's a header followed by runs of (input, ui16 length), since the
+// keys held down tend to stay the same for many steps.
+
+namespace REC
+{
+	const ui32 kMagic = 0x43525450; // "PTRC"
+	const ui32 kVersion = 3;
+
+	struct recording
+	{
+		ui32 seed;
+		ui32 characters;
+		ui32 chasers;
+		sizei viewSize;
+		bool lod;
+
+		ui32 steps;
+		ui32 capacity;
+		SIM::input *inputs;
+
+		recording() : seed(0), characters(0), chasers(0), lod(true), steps(0), capacity(0), inputs(0) {}
+	};
+
+	void begin(recording &r, ui32 seed, ui32 characters, ui32 chasers, sizei viewSize, bool lod);
+	void record(recording &r, SIM::input in);
+	bool save(const recording &r, const char *filename);
+	bool load(recording &r, const char *filename);
+	void release(recording &r);
+}
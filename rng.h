@@ -0,0 +1,59 @@
+// RNG stands for random number generator. Every entity carries its own
+// xoshiro128** stream, so what it draws only depends on its seed and not on
+// who else drew before it or on which thread. SIMD::random() advances many
+// streams at once and gives the same numbers next() would.
+
+namespace RNG
+{
+	struct stream
+	{
+		ui32 s[4];
+	};
+
+	inline ui32 rotl(ui32 x, int k)
+	{
+		return (x << k) | (x >> (32 - k));
+	}
+
+	// splitmix64 spreads the seed over the whole state, which must never be all zeros
+	inline void seed(stream &r, ui64 seed)
+	{
+		for (int i = 0; i < 4; i += 2)
+		{
+			ui64 z = (seed += 0x9E3779B97F4A7C15ULL);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			z = z ^ (z >> 31);
+
+			r.s[i] = static_cast<ui32>(z);
+			r.s[i + 1] = static_cast<ui32>(z >> 32);
+		}
+	}
+
+	inline ui32 next(stream &r)
+	{
+		const ui32 result = rotl(r.s[1] * 5, 7) * 9;
+		const ui32 t = r.s[1] << 9;
+
+		r.s[2] ^= r.s[0];
+		r.s[3] ^= r.s[1];
+		r.s[1] ^= r.s[2];
+		r.s[0] ^= r.s[3];
+		r.s[2] ^= t;
+		r.s[3] = rotl(r.s[3], 11);
+
+		return result;
+	}
+
+	// uniform in [0, n), the stand-in for rand() % n
+	inline ui32 below(stream &r, ui32 n)
+	{
+		return static_cast<ui32>((static_cast<ui64>(next(r)) * n) >> 32);
+	}
+
+	// uniform in [0, n) from the low 16 bits of a draw, so one draw can settle two things
+	inline ui32 below16(ui32 bits, ui32 n)
+	{
+		return ((bits & 0xFFFF) * n) >> 16;
+	}
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <string.h>
+#include "elementals.h"
+#include "fixed.h"
+#include "map.h"
+#include "collision.h"
+#include "rng.h"
+#include "entities.h"
+#include "projectiles.h"
+#include "sim.h"
+#include "rollback.h"
+
+namespace ROLL
+{
+	void init(ring &r, ui32 capacity)
+	{
+		release(r);
+
+		r.worlds = new SIM::world[capacity > 0 ? capacity : 1];
+		r.mapRevisions = new ui32[capacity > 0 ? capacity : 1];
+		r.capacity = (capacity > 0 ? capacity : 1);
+	}
+
+	void release(ring &r)
+	{
+		delete[] r.worlds;
+		delete[] r.mapRevisions;
+
+		r.worlds = 0;
+		r.mapRevisions = 0;
+		r.capacity = 0;
+		r.count = 0;
+		r.newest = 0;
+	}
+
+	void clear(ring &r)
+	{
+		r.count = 0;
+		r.newest = 0;
+	}
+
+	void save(ring &r, const SIM::world &w)
+	{
+		// anything from this step on is about to be replaced, that's what a resimulation does
+
+		while (r.count > 0 && r.worlds[r.newest].stepCount >= w.stepCount)
+		{
+			r.newest = (r.newest + r.capacity - 1) % r.capacity;
+			r.count--;
+		}
+
+		r.newest = (r.newest + 1) % r.capacity;
+
+		if (r.count < r.capacity)
+		{
+			r.count++;
+		}
+
+		memcpy(&r.worlds[r.newest], &w, sizeof(SIM::world));
+		r.mapRevisions[r.newest] = MAP::mapData.revision;
+	}
+
+	bool restore(ring &r, SIM::world &w, ui32 step)
+	{
+		for (ui32 n = 0; n < r.count; n++)
+		{
+			ui32 i = (r.newest + r.capacity - n) % r.capacity;
+
+			if (r.worlds[i].stepCount == step)
+			{
+				if (!MAP::rewind(r.mapRevisions[i]))
+				{
+					return false;
+				}
+
+				memcpy(&w, &r.worlds[i], sizeof(SIM::world));
+
+				r.newest = i;
+				r.count -= n;
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
@@ -0,0 +1,33 @@
+// ROLL stands for rollback. The world is plain data with no pointers in it,
+// so a snapshot is a single memcpy into a ring of worlds allocated up front.
+// Saving and restoring never allocate. The ring holds the state at the start
+// of the last few saved steps; restoring one throws away everything newer,
+// since resimulating from there saves those steps again.
+//
+// A snapshot is as big as the world, which is mostly ENT::kMaxEntities
+// sized arrays, so ENT_MAX_ENTITIES is the knob for making rollback cheaper.
+
+namespace ROLL
+{
+	struct ring
+	{
+		SIM::world *worlds;
+		ui32 *mapRevisions; // MAP revision when each world was saved, the map being rewound along with it
+		ui32 capacity;
+		ui32 count;
+		ui32 newest;
+
+		ring() : worlds(0), mapRevisions(0), capacity(0), count(0), newest(0) {}
+	};
+
+	void init(ring &r, ui32 capacity);
+	void release(ring &r);
+	void clear(ring &r);
+
+	// saves the world as it is before its next step
+	void save(ring &r, const SIM::world &w);
+
+	// puts the world back to the start of the given step, and the map's tiles with it. False if that step
+	// is no longer in the ring, or its tiles are no longer in the map's journal
+	bool restore(ring &r, SIM::world &w, ui32 step);
+}
@@ -0,0 +1,1633 @@
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "elementals.h"
+#include "fixed.h"
+#include "textures.h"
+#include "map.h"
+#include "collision.h"
+#include "rng.h"
+#include "entities.h"
+#include "projectiles.h"
+#include "simd.h"
+#include "jobs.h"
+#include "bt.h"
+#include "sim.h"
+#include "nav.h"
+
+rectf boundingBox(i32 sprite_id, const pointf &pos);
+
+namespace SIM
+{
+	static f64 secondsPerCount = 0.0;
+
+	// grain sizes for splitting systems across the pool, below these a system runs on a single thread
+
+	const ui32 kAIGrain = 64;
+
+	// ai draws its random numbers for a block of agents at once, kAIDraws each per step
+	const ui32 kAIBlock = 256;
+	const ui32 kAIDraws = 3;
+	const ui32 kIntegrateGrain = 2048;
+	const ui32 kCollisionGrain = 32;
+	const ui32 kAnimationGrain = 512;
+
+	// a kick request stores the kicker's facing, kickTarget tells who gets it
+	enum { kKickNone = 0, kKickLeft, kKickRight };
+
+	const ui32 kKickEveryone = 0xFFFFFFFF;
+
+	const scalar kReducedDt = dt * scalar(static_cast<f32>(kLodInterval));
+
+	// systems see the full rate entities followed by the slice of reduced ones due this step,
+	// as if they were a single range of activeCount entities
+
+	struct stepContext
+	{
+		world *w;
+		input in;
+		ui32 players[kMaxPlayers];
+		ui32 playerCount;
+		ui32 fullCount;
+		ui32 sliceBegin;
+		ui32 activeCount;
+
+		// agents whose turn it is to think this step start at thinkTurn, counting the way n does
+		ui32 thinkTurn;
+		volatile LONG thinkCount;
+	};
+
+	static inline ui32 entityAt(const stepContext &ctx, ui32 n)
+	{
+		return (n < ctx.fullCount ? n : ctx.sliceBegin + (n - ctx.fullCount));
+	}
+
+	static inline scalar stepTime(const stepContext &ctx, ui32 n)
+	{
+		return (n < ctx.fullCount ? dt : kReducedDt);
+	}
+
+	static bool isCharacter(const ENT::store &e, ui32 i)
+	{
+		return (e.flags[i] & (ENT::kFlagPlayer | ENT::kFlagAI)) != 0;
+	}
+
+	static rects characterBox(const ENT::store &e, ui32 i)
+	{
+		rectf rc = boundingBox(e.sprite[i], pointf(0.0f, 0.0f));
+
+		return rects(e.posX[i] + scalar(rc.x), e.posY[i] + scalar(rc.y), scalar(rc.width), scalar(rc.height));
+	}
+
+	// characters touch where the opaque pixels of the frames they're showing do, sprites without masks fall
+	// back to their boxes
+
+	static bool touching(const ENT::store &e, ui32 i, ui32 j)
+	{
+		const TX::sprite &a = TX::sprites[e.sprite[i]];
+		const TX::sprite &b = TX::sprites[e.sprite[j]];
+
+		if (!a.mask || !b.mask)
+		{
+			return characterBox(e, i).intersects(characterBox(e, j));
+		}
+
+		return TX::masksOverlap(e.sprite[i], e.frame[i], e.flip[i] != 0, pointi(floorToInt(e.posX[i]) - a.origin.x, floorToInt(e.posY[i]) - a.origin.y),
+			e.sprite[j], e.frame[j], e.flip[j] != 0, pointi(floorToInt(e.posX[j]) - b.origin.x, floorToInt(e.posY[j]) - b.origin.y));
+	}
+
+	static void linkBrains();
+
+	static void kick(ENT::store &e, ui32 target, bool flip)
+	{
+		e.kicked[target] = 1;
+		e.kickedTime[target] = scalar(0);
+		e.kickedVelX[target] = scalar(flip ? 300.0f : -300.0f);
+		e.kickedVelY[target] = scalar(-500.0f);
+	}
+
+	f64 now()
+	{
+		LARGE_INTEGER counter;
+
+		if (secondsPerCount == 0.0)
+		{
+			LARGE_INTEGER frequency;
+			QueryPerformanceFrequency(&frequency);
+			secondsPerCount = 1.0 / static_cast<f64>(frequency.QuadPart);
+		}
+
+		QueryPerformanceCounter(&counter);
+
+		return static_cast<f64>(counter.QuadPart) * secondsPerCount;
+	}
+
+	void init(world &w, sizei viewSize, ui32 seed)
+	{
+		ENT::store &e = w.entities;
+
+		ENT::reset(e);
+		PRJ::reset(w.projectiles);
+
+		linkBrains();
+
+		w.seed = seed;
+		w.spawnCount = 0;
+		RNG::seed(w.rng, seed);
+
+		ENT::handle perro = spawnCharacter(w, TX::PerroFrames, pointf(260.0f, 200.0f), ENT::kFlagPlayer);
+		spawnCharacter(w, TX::Ruby, pointf(560.0f, 200.0f), ENT::kFlagAI);
+
+		// camera
+
+		w.camera = ENT::spawn(e);
+		w.cameraTarget = perro;
+		w.viewSize = viewSize;
+
+		ui32 c = ENT::index(e, w.camera);
+
+		e.posX[c] = e.prevX[c] = scalar(viewSize.width / 2);
+		e.posY[c] = e.prevY[c] = scalar(viewSize.height / 2);
+
+		// input
+
+		w.keyCtrlPressed = false;
+		w.keySpacePressed = false;
+		w.keyThrowPressed = false;
+		w.mapEdited = false;
+
+		// level of detail
+
+		w.lod = true;
+		w.lodFullDistance = max(viewSize.width, viewSize.height) / 2 + kLodMargin;
+		w.lodFrozenDistance = w.lodFullDistance + kLodReducedBand;
+		w.lodFull = w.lodReduced = e.count;
+		w.lodCount = e.count;
+
+		// ai
+
+		w.thinkTurn = 0;
+
+		// clock
+
+		w.t = 0.0;
+		w.stepCount = 0;
+	}
+
+	ENT::handle spawnCharacter(world &w, i32 sprite, pointf position, ui8 flags)
+	{
+		ENT::store &e = w.entities;
+		ENT::handle h = ENT::spawn(e);
+
+		if (h == ENT::kInvalidHandle)
+		{
+			return h;
+		}
+
+		ui32 i = ENT::index(e, h);
+
+		e.posX[i] = e.prevX[i] = scalar(position.x);
+		e.posY[i] = e.prevY[i] = scalar(position.y);
+		e.accY[i] = g;
+		e.flags[i] = flags | ENT::kFlagCollides | ENT::kFlagDrawn;
+		e.sprite[i] = static_cast<ui8>(sprite);
+		e.animTime[i] = scalar(-1.0f);
+		e.kickStep[i] = 0;
+		e.kickedTime[i] = kMaxKickedTime + scalar(1.0f);
+		e.thinkStep[i] = kThinkNow;
+		e.brain[i] = static_cast<ui8>(flags & ENT::kFlagAI ? kBrainRuby : kBrainNone);
+		e.walkDirection[i] = kNone;
+		e.willJumpDirection[i] = kNone;
+		e.navCell[i] = NAV::kNone;
+		e.navRoute[i] = NAV::kNone;
+
+		// seeded by spawn order, so the same spawns give the same streams whatever slot they land in
+		RNG::seed(e.rng[i], (static_cast<ui64>(w.seed) << 32) | w.spawnCount++);
+
+		return h;
+	}
+
+	void spawnCrowd(world &w, ui32 count, Brain brain)
+	{
+		const i32 mapWidth = MAP::getWidth() * MAP::getTileSize();
+		const i32 mapHeight = MAP::getHeight() * MAP::getTileSize();
+
+		// random spots where ruby fits, giving up after enough misses so a full map can't hang us
+
+		for (ui32 attempts = 0; count > 0 && attempts < 1000000; attempts++)
+		{
+			pointf position(
+				static_cast<f32>(RNG::below(w.rng, mapWidth)),
+				static_cast<f32>(RNG::below(w.rng, mapHeight))
+			);
+
+			recti rc = boundingBox(TX::Ruby, position);
+
+			if (rc.x < 0 || rc.y < 0 || rc.x + rc.width >= mapWidth || rc.y + rc.height >= mapHeight || MAP::collides(rc))
+			{
+				continue;
+			}
+
+			ENT::handle h = spawnCharacter(w, TX::Ruby, position, ENT::kFlagAI);
+
+			if (h == ENT::kInvalidHandle)
+			{
+				break;
+			}
+
+			w.entities.brain[ENT::index(w.entities, h)] = static_cast<ui8>(brain);
+
+			count--;
+		}
+	}
+
+	// the camera goes first so it can be integrated along with everything else,
+	// it chases where its target ended up after the previous step
+
+	static void updateCamera(world &w, input in)
+	{
+		ENT::store &e = w.entities;
+
+		if (in & kKeyCamera)
+		{
+			if (!w.keySpacePressed)
+			{
+				ui32 first = (ENT::alive(e, w.cameraTarget) ? ENT::index(e, w.cameraTarget) + 1 : 0);
+
+				for (ui32 n = 0; n < e.count; n++)
+				{
+					ui32 i = (first + n) % e.count;
+
+					if (isCharacter(e, i))
+					{
+						w.cameraTarget = e.id[i];
+						break;
+					}
+				}
+			}
+
+			w.keySpacePressed = true;
+		}
+		else
+		{
+			w.keySpacePressed = false;
+		}
+
+		if (!ENT::alive(e, w.camera))
+		{
+			return;
+		}
+
+		ui32 c = ENT::index(e, w.camera);
+
+		vectors cameraObjective(e.posX[c], e.posY[c]);
+
+		if (ENT::alive(e, w.cameraTarget))
+		{
+			ui32 target = ENT::index(e, w.cameraTarget);
+
+			cameraObjective = vectors(e.posX[target], e.posY[target]);
+		}
+
+		const vectors cameraMin(scalar(w.viewSize.width / 2), scalar(w.viewSize.height / 2));
+		const vectors cameraMax(scalar(MAP::getWidth() * MAP::getTileSize() - w.viewSize.width / 2), scalar(MAP::getHeight() * MAP::getTileSize() - w.viewSize.height / 2));
+
+		// keep camera within map bounds
+		cameraObjective.x = min(max(cameraMin.x, cameraObjective.x), cameraMax.x);
+		cameraObjective.y = min(max(cameraMin.y, cameraObjective.y), cameraMax.y);
+
+		// and the camera itself, for a map smaller than the view
+		e.posX[c] = min(max(cameraMin.x, e.posX[c]), cameraMax.x);
+		e.posY[c] = min(max(cameraMin.y, e.posY[c]), cameraMax.y);
+
+		e.velX[c] = (cameraObjective.x - e.posX[c]) * scalar(2.5f);
+		e.velY[c] = (cameraObjective.y - e.posY[c]) * scalar(2.5f);
+
+		if (abs(e.velX[c]) < scalar(20.0f))
+		{
+			e.velX[c] = scalar(0);
+		}
+
+		if (abs(e.velY[c]) < scalar(20.0f))
+		{
+			e.velY[c] = scalar(0);
+		}
+	}
+
+	static void playerControl(world &w, ui32 i, input in)
+	{
+		ENT::store &e = w.entities;
+		collision::info &collides = e.collides[i];
+
+		if (e.kickedTime[i] > kMaxKickedTime)
+		{
+			e.angle[i] = 0.0f;
+			e.velX[i] = scalar(0);
+
+			if (collides.bottom() && (in & kKeyUp))
+			{
+				e.velY[i] = -kJump;
+			}
+
+			if (!e.isKicking[i] || !collides.bottom())
+			{
+				if (in & kKeyLeft)
+				{
+					e.flip[i] = false;
+					e.velX[i] = -kVel;
+				}
+
+				if (in & kKeyRight)
+				{
+					e.flip[i] = true;
+					e.velX[i] = kVel;
+				}
+			}
+
+			if (in & kKeyKick)
+			{
+				if (!w.keyCtrlPressed)
+				{
+					e.isKicking[i] = true;
+					e.kickStep[i] = w.stepCount;
+
+					e.kickRequest[i] = (e.flip[i] ? kKickRight : kKickLeft);
+					e.kickTarget[i] = kKickEveryone;
+				}
+
+				w.keyCtrlPressed = true;
+			}
+			else
+			{
+				w.keyCtrlPressed = false;
+			}
+		}
+		else
+		{
+			e.angle[i] = 10.0f * (e.kickedVelX[i] > scalar(0) ? -1.0f : 1.0f);
+
+			if (collides.bottom())
+			{
+				e.kickedVelX[i] = e.kickedVelX[i] * scalar(0.99f);
+			}
+		}
+
+		if (collides.right() || collides.left())
+		{
+			e.kickedTime[i] = kMaxKickedTime + scalar(1.0f);
+		}
+
+		if (e.isKicking[i] && collides.bottom())
+		{
+			e.velX[i] = scalar(0);
+			e.velY[i] = scalar(0);
+		}
+
+		if (e.isKicking[i] && (w.stepCount - e.kickStep[i]) > kKickSteps)
+		{
+			e.isKicking[i] = false;
+		}
+
+		if (e.kickedTime[i] < kMaxKickedTime)
+		{
+			e.isKicking[i] = false;
+
+			if (e.kicked[i])
+			{
+				e.velY[i] = e.kickedVelY[i];
+				e.kicked[i] = false;
+			}
+
+			e.velX[i] = e.kickedVelX[i];
+			e.kickedTime[i] += dt;
+		}
+	}
+
+	// ruby's brain as two behaviour trees, run for every agent that isn't flying from a kick: the
+	// first one only when the agent's turn to think comes up, the second one every step
+
+	enum Leaf
+	{
+		kLeafTouchingPlayer = 0,
+		kLeafChance,
+		kLeafStartKick,
+		kLeafWall,
+		kLeafPlanJump,
+		kLeafThinkTime,
+		kLeafNotKicking,
+		kLeafResetTimer,
+		kLeafOnGround,
+		kLeafJump,
+		kLeafHeading,
+		kLeafCollided,
+		kLeafPickWalk,
+		kLeafAdvanceTimer,
+		kLeafJumpPlanned,
+		kLeafPlannedJump,
+		kLeafWalk,
+		kLeafHasRoute,
+		kLeafFollowRoute,
+		kLeafCount
+	};
+
+	// rolls are this step's kAIDraws numbers from the agent's stream, each split in two 16 bit halves
+	enum Roll { kRollKick = 0, kRollJumpDirection, kRollJump, kRollWalkChange, kRollWalkDirection };
+
+	static BT::node rubyThink[] =
+	{
+		{ 0, BT::kAll },
+
+		// kick a player we're touching, now and then, rolling first since it's cheaper than the overlap test
+		{ 1, BT::kSequence },
+		{ 2, BT::kLeaf, kLeafChance, kRollKick, 1 },
+		{ 2, BT::kLeaf, kLeafTouchingPlayer },
+		{ 2, BT::kLeaf, kLeafStartKick },
+
+		// a wall means jumping next time we land, mostly over it
+		{ 1, BT::kSelector },
+		{ 2, BT::kSequence },
+		{ 3, BT::kLeaf, kLeafWall, kRight },
+		{ 3, BT::kSelector },
+		{ 4, BT::kSequence },
+		{ 5, BT::kLeaf, kLeafChance, kRollJumpDirection, 70 },
+		{ 5, BT::kLeaf, kLeafPlanJump, kRight },
+		{ 4, BT::kLeaf, kLeafPlanJump, kLeft },
+		{ 2, BT::kSequence },
+		{ 3, BT::kLeaf, kLeafWall, kLeft },
+		{ 3, BT::kSelector },
+		{ 4, BT::kSequence },
+		{ 5, BT::kLeaf, kLeafChance, kRollJumpDirection, 70 },
+		{ 5, BT::kLeaf, kLeafPlanJump, kLeft },
+		{ 4, BT::kLeaf, kLeafPlanJump, kRight },
+
+		// once a second, maybe jump and maybe change where we're walking
+		{ 1, BT::kSequence },
+		{ 2, BT::kLeaf, kLeafThinkTime },
+		{ 2, BT::kLeaf, kLeafNotKicking },
+		{ 2, BT::kLeaf, kLeafResetTimer },
+		{ 2, BT::kAll },
+		{ 3, BT::kSequence },
+		{ 4, BT::kLeaf, kLeafOnGround },
+		{ 4, BT::kLeaf, kLeafChance, kRollJump, 20 },
+		{ 4, BT::kLeaf, kLeafJump },
+		{ 3, BT::kSequence },
+		{ 4, BT::kSelector },
+		{ 5, BT::kLeaf, kLeafHeading, kNone },
+		{ 5, BT::kLeaf, kLeafCollided },
+		{ 5, BT::kLeaf, kLeafChance, kRollWalkChange, 10 },
+		{ 4, BT::kLeaf, kLeafPickWalk, kRollWalkDirection }
+	};
+
+	static BT::node rubyReflex[] =
+	{
+		{ 0, BT::kAll },
+
+		{ 1, BT::kLeaf, kLeafAdvanceTimer },
+
+		{ 1, BT::kSequence },
+		{ 2, BT::kLeaf, kLeafOnGround },
+		{ 2, BT::kLeaf, kLeafJumpPlanned },
+		{ 2, BT::kLeaf, kLeafPlannedJump },
+
+		{ 1, BT::kLeaf, kLeafWalk }
+	};
+
+	// chasers kick like ruby does and otherwise follow NAV's route to the player, standing still
+	// when there's none
+
+	static BT::node chaserThink[] =
+	{
+		{ 0, BT::kSequence },
+		{ 1, BT::kLeaf, kLeafChance, kRollKick, 1 },
+		{ 1, BT::kLeaf, kLeafTouchingPlayer },
+		{ 1, BT::kLeaf, kLeafStartKick }
+	};
+
+	static BT::node chaserReflex[] =
+	{
+		{ 0, BT::kSelector },
+		{ 1, BT::kSequence },
+		{ 2, BT::kLeaf, kLeafHasRoute },
+		{ 2, BT::kLeaf, kLeafFollowRoute },
+		{ 1, BT::kLeaf, kLeafWalk }
+	};
+
+	// what the leaves work on, one block of agents at a time
+
+	struct aiBatch
+	{
+		world *w;
+		const stepContext *ctx;
+		const ui32 *rolls;
+		ui32 first;
+		ui32 count;
+		scalar delta;
+	};
+
+	static inline ui32 roll(const aiBatch &b, ui32 i, i32 which)
+	{
+		return b.rolls[(which / 2) * b.count + (i - b.first)] >> (16 * (which % 2));
+	}
+
+	static ui32 leafTouchingPlayer(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+		ui32 passed = 0;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			ui32 i = agents[k];
+
+			for (ui32 p = 0; p < b.ctx->playerCount; p++)
+			{
+				ui32 j = b.ctx->players[p];
+
+				if (touching(e, i, j))
+				{
+					e.kickTarget[i] = j;
+					BT::pass(agents, passed, k);
+					break;
+				}
+			}
+		}
+
+		return passed;
+	}
+
+	static ui32 leafChance(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ui32 passed = 0;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			if (RNG::below16(roll(b, agents[k], n.a), 100) < static_cast<ui32>(n.b))
+			{
+				BT::pass(agents, passed, k);
+			}
+		}
+
+		return passed;
+	}
+
+	static ui32 leafStartKick(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			ui32 i = agents[k];
+
+			e.isKicking[i] = true;
+			e.kickStep[i] = b.w->stepCount;
+			e.kickRequest[i] = (e.flip[i] ? kKickRight : kKickLeft);
+		}
+
+		return count;
+	}
+
+	static ui32 leafWall(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+		ui32 passed = 0;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			collision::info &collides = e.collides[agents[k]];
+
+			if (n.a == kRight ? collides.right() : collides.left())
+			{
+				BT::pass(agents, passed, k);
+			}
+		}
+
+		return passed;
+	}
+
+	static ui32 leafPlanJump(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			e.willJump[agents[k]] = true;
+			e.willJumpDirection[agents[k]] = static_cast<ui8>(n.a);
+		}
+
+		return count;
+	}
+
+	static ui32 leafThinkTime(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+		ui32 passed = 0;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			if (e.aiTime[agents[k]] >= scalar(1.0f))
+			{
+				BT::pass(agents, passed, k);
+			}
+		}
+
+		return passed;
+	}
+
+	static ui32 leafNotKicking(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+		ui32 passed = 0;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			if (!e.isKicking[agents[k]])
+			{
+				BT::pass(agents, passed, k);
+			}
+		}
+
+		return passed;
+	}
+
+	static ui32 leafResetTimer(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			e.aiTime[agents[k]] = scalar(0);
+		}
+
+		return count;
+	}
+
+	static ui32 leafOnGround(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+		ui32 passed = 0;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			if (e.collides[agents[k]].bottom())
+			{
+				BT::pass(agents, passed, k);
+			}
+		}
+
+		return passed;
+	}
+
+	static ui32 leafJump(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			e.velY[agents[k]] = -kJump;
+		}
+
+		return count;
+	}
+
+	static ui32 leafHeading(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+		ui32 passed = 0;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			if (e.walkDirection[agents[k]] == n.a)
+			{
+				BT::pass(agents, passed, k);
+			}
+		}
+
+		return passed;
+	}
+
+	static ui32 leafCollided(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+		ui32 passed = 0;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			if (e.collided[agents[k]])
+			{
+				BT::pass(agents, passed, k);
+			}
+		}
+
+		return passed;
+	}
+
+	static ui32 leafPickWalk(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		static const ui8 directions[3] = { kRight, kLeft, kNone };
+
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			e.walkDirection[agents[k]] = directions[RNG::below16(roll(b, agents[k], n.a), 3)];
+		}
+
+		return count;
+	}
+
+	static ui32 leafAdvanceTimer(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			e.aiTime[agents[k]] += b.delta;
+		}
+
+		return count;
+	}
+
+	static ui32 leafJumpPlanned(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+		ui32 passed = 0;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			if (e.willJump[agents[k]])
+			{
+				BT::pass(agents, passed, k);
+			}
+		}
+
+		return passed;
+	}
+
+	static ui32 leafPlannedJump(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			ui32 i = agents[k];
+
+			e.willJump[i] = false;
+			e.velY[i] = -kJump;
+			e.walkDirection[i] = e.willJumpDirection[i];
+			e.aiTime[i] = scalar(0);
+		}
+
+		return count;
+	}
+
+	static ui32 leafWalk(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			ui32 i = agents[k];
+
+			e.velX[i] = scalar(0);
+
+			if (e.walkDirection[i] == kLeft)
+			{
+				e.flip[i] = false;
+				e.velX[i] = -kVel;
+			}
+			else if (e.walkDirection[i] == kRight)
+			{
+				e.flip[i] = true;
+				e.velX[i] = kVel;
+			}
+		}
+
+		return count;
+	}
+
+	static ui32 leafHasRoute(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+		ui32 passed = 0;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			if (e.navRoute[agents[k]] != NAV::kNone)
+			{
+				BT::pass(agents, passed, k);
+			}
+		}
+
+		return passed;
+	}
+
+	// holds the edge's speed the whole way, like NAV did when it found it, and takes off from the ground
+	// when the edge is a jump
+
+	static ui32 leafFollowRoute(void *context, const BT::node &n, ui32 *agents, ui32 count)
+	{
+		aiBatch &b = *static_cast<aiBatch *>(context);
+		ENT::store &e = b.w->entities;
+
+		for (ui32 k = 0; k < count; k++)
+		{
+			ui32 i = agents[k];
+			const i8 speed = NAV::routeSpeed(e.navRoute[i]);
+
+			e.velX[i] = kVel * scalar(speed * 0.25f);
+			e.flip[i] = (speed > 0);
+
+			if (NAV::routeMove(e.navRoute[i]) == NAV::kMoveJump && e.collides[i].bottom())
+			{
+				e.velY[i] = -kJump;
+			}
+		}
+
+		return count;
+	}
+
+	static const BT::leafFn leaves[kLeafCount] =
+	{
+		leafTouchingPlayer,
+		leafChance,
+		leafStartKick,
+		leafWall,
+		leafPlanJump,
+		leafThinkTime,
+		leafNotKicking,
+		leafResetTimer,
+		leafOnGround,
+		leafJump,
+		leafHeading,
+		leafCollided,
+		leafPickWalk,
+		leafAdvanceTimer,
+		leafJumpPlanned,
+		leafPlannedJump,
+		leafWalk,
+		leafHasRoute,
+		leafFollowRoute
+	};
+
+	// trees per brain, indexed by ENT::store::brain
+	static const BT::node *thinkTrees[kBrainCount] = { 0, rubyThink, chaserThink };
+	static const BT::node *reflexTrees[kBrainCount] = { 0, rubyReflex, chaserReflex };
+
+	static void linkBrains()
+	{
+		BT::link(rubyThink, sizeof(rubyThink) / sizeof(rubyThink[0]));
+		BT::link(rubyReflex, sizeof(rubyReflex) / sizeof(rubyReflex[0]));
+		BT::link(chaserThink, sizeof(chaserThink) / sizeof(chaserThink[0]));
+		BT::link(chaserReflex, sizeof(chaserReflex) / sizeof(chaserReflex[0]));
+	}
+
+	// the parts of an agent's step that are the same for any brain, before and after its tree runs
+
+	static bool aiBefore(ENT::store &e, ui32 i)
+	{
+		collision::info &collides = e.collides[i];
+
+		if (collides)
+		{
+			e.collided[i] = true;
+		}
+
+		if (collides.left() || collides.right())
+		{
+			e.kickedTime[i] = kMaxKickedTime + scalar(1.0f);
+		}
+
+		if (e.kickedTime[i] > kMaxKickedTime)
+		{
+			e.angle[i] = 0.0f;
+			return true;
+		}
+
+		return false;
+	}
+
+	static void aiAfter(world &w, ui32 i, scalar delta)
+	{
+		ENT::store &e = w.entities;
+		collision::info &collides = e.collides[i];
+
+		if (e.kickedTime[i] <= kMaxKickedTime)
+		{
+			e.angle[i] = 10.0f * (e.kickedVelX[i] > scalar(0) ? -1.0f : 1.0f);
+
+			if (collides.bottom())
+			{
+				e.kickedVelX[i] = e.kickedVelX[i] * scalar(0.99f);
+			}
+
+			e.isKicking[i] = false;
+
+			if (e.kicked[i])
+			{
+				e.velY[i] = e.kickedVelY[i];
+				e.kicked[i] = false;
+			}
+
+			e.velX[i] = e.kickedVelX[i];
+			e.kickedTime[i] += delta;
+		}
+
+		if (e.isKicking[i] && collides.bottom())
+		{
+			e.velX[i] = scalar(0);
+			e.velY[i] = scalar(0);
+		}
+
+		if (e.isKicking[i] && (w.stepCount - e.kickStep[i]) > kKickSteps)
+		{
+			e.isKicking[i] = false;
+		}
+
+		if (e.kickedTime[i] < kMaxKickedTime)
+		{
+			e.isKicking[i] = false;
+		}
+	}
+
+	// sorts entities into [full | reduced | frozen] by their distance to whatever the player can see or touch
+
+	static void updateLod(world &w)
+	{
+		ENT::store &e = w.entities;
+
+		vectors anchors[kMaxPlayers + 2];
+		ui32 anchorCount = 0;
+
+		if (ENT::alive(e, w.camera))
+		{
+			ui32 c = ENT::index(e, w.camera);
+			anchors[anchorCount++] = vectors(e.posX[c], e.posY[c]);
+		}
+
+		if (ENT::alive(e, w.cameraTarget))
+		{
+			ui32 target = ENT::index(e, w.cameraTarget);
+			anchors[anchorCount++] = vectors(e.posX[target], e.posY[target]);
+		}
+
+		for (ui32 i = 0; i < e.count && anchorCount < kMaxPlayers + 2; i++)
+		{
+			if (e.flags[i] & ENT::kFlagPlayer)
+			{
+				anchors[anchorCount++] = vectors(e.posX[i], e.posY[i]);
+			}
+		}
+
+		for (ui32 i = 0; i < e.count; i++)
+		{
+			i32 distance = w.lodFrozenDistance;
+
+			for (ui32 k = 0; k < anchorCount; k++)
+			{
+				i32 dx = floorToInt(abs(e.posX[i] - anchors[k].x));
+				i32 dy = floorToInt(abs(e.posY[i] - anchors[k].y));
+
+				distance = min(distance, max(dx, dy));
+			}
+
+			e.lod[i] = (distance < w.lodFullDistance ? kLodFull : distance < w.lodFrozenDistance ? kLodReduced : kLodFrozen);
+		}
+
+		// three way partition, leaving alone whatever is already in place
+
+		ui32 lo = 0, mid = 0, hi = e.count;
+
+		while (mid < hi)
+		{
+			if (e.lod[mid] == kLodFull)
+			{
+				ENT::swap(e, lo++, mid++);
+			}
+			else if (e.lod[mid] == kLodReduced)
+			{
+				mid++;
+			}
+			else if (e.lod[hi - 1] == kLodFrozen)
+			{
+				hi--;
+			}
+			else
+			{
+				ENT::swap(e, mid, --hi);
+			}
+		}
+
+		w.lodFull = lo;
+		w.lodReduced = mid;
+		w.lodCount = e.count;
+	}
+
+	// systems, each one takes a range of dense indices so the pool can split it
+
+	static void cameraSystem(void *context, ui32 begin, ui32 end)
+	{
+		stepContext &ctx = *static_cast<stepContext *>(context);
+
+		updateCamera(*ctx.w, ctx.in);
+	}
+
+	static void playerSystem(void *context, ui32 begin, ui32 end)
+	{
+		stepContext &ctx = *static_cast<stepContext *>(context);
+
+		for (ui32 n = begin; n < end; n++)
+		{
+			playerControl(*ctx.w, ctx.players[n], ctx.in);
+		}
+	}
+
+	static inline bool isAgent(const ENT::store &e, ui32 i)
+	{
+		return (e.flags[i] & ENT::kFlagAI) && !(e.flags[i] & ENT::kFlagPlayer);
+	}
+
+	// an agent thinks right away after a wall or a kick and all the time near a player, otherwise when
+	// it's due and its turn comes up; turns go round kThinksPerStep agents a step
+
+	static bool nearPlayer(const stepContext &ctx, const ENT::store &e, ui32 i)
+	{
+		const scalar distance = scalar(static_cast<f32>(kThinkNearDistance));
+
+		for (ui32 p = 0; p < ctx.playerCount; p++)
+		{
+			ui32 j = ctx.players[p];
+
+			if (abs(e.posX[i] - e.posX[j]) < distance && abs(e.posY[i] - e.posY[j]) < distance)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	static bool thinks(const stepContext &ctx, ui32 n, ui32 i)
+	{
+		world &w = *ctx.w;
+		ENT::store &e = w.entities;
+
+		if (e.thinkStep[i] == kThinkNow || e.collides[i].left() || e.collides[i].right())
+		{
+			return true;
+		}
+
+		if (n < ctx.fullCount && nearPlayer(ctx, e, i))
+		{
+			return true;
+		}
+
+		ui32 turn = (n >= ctx.thinkTurn ? n - ctx.thinkTurn : n + ctx.activeCount - ctx.thinkTurn);
+
+		return turn < kThinksPerStep && static_cast<i32>(w.stepCount - e.thinkStep[i]) >= 0;
+	}
+
+	// NAV keeps its search scratch and cache to itself, so routes are looked up here on one thread
+	// before ai runs. Players keep track of where they stand, and each one gets a flow field towards
+	// it that all of its chasers share
+
+	static void navSystem(void *context, ui32 begin, ui32 end)
+	{
+		stepContext &ctx = *static_cast<stepContext *>(context);
+		ENT::store &e = ctx.w->entities;
+
+		if (NAV::navGraph.nodeCount == 0)
+		{
+			return;
+		}
+
+		// there are never more players than fields NAV keeps, so none of these push another one out
+
+		const ui32 *fields[kMaxPlayers];
+
+		for (ui32 p = 0; p < ctx.playerCount; p++)
+		{
+			ui32 j = ctx.players[p];
+			ui32 node = NAV::nodeAt(e.posX[j], e.posY[j]);
+
+			if (node != NAV::kNone && e.collides[j].bottom())
+			{
+				e.navCell[j] = NAV::cellOf(node);
+			}
+
+			const ui32 goal = NAV::nodeOf(e.navCell[j]);
+
+			fields[p] = (goal != NAV::kNone ? NAV::flow(goal) : 0);
+		}
+
+		// chasers pick their next move whenever they're on the ground, in the air they stick to the last one
+
+		for (ui32 n = 0; n < ctx.activeCount; n++)
+		{
+			ui32 i = entityAt(ctx, n);
+
+			if (e.brain[i] != kBrainChaser || !isAgent(e, i) || !e.collides[i].bottom())
+			{
+				continue;
+			}
+
+			ui32 node = NAV::nodeAt(e.posX[i], e.posY[i]);
+			const ui32 *field = 0;
+			scalar closest = scalar(0);
+
+			if (node != NAV::kNone)
+			{
+				e.navCell[i] = NAV::cellOf(node);
+			}
+
+			for (ui32 p = 0; p < ctx.playerCount; p++)
+			{
+				ui32 j = ctx.players[p];
+				scalar distance = max(abs(e.posX[i] - e.posX[j]), abs(e.posY[i] - e.posY[j]));
+
+				if (p == 0 || distance < closest)
+				{
+					field = fields[p];
+					closest = distance;
+				}
+			}
+
+			const ui32 from = NAV::nodeOf(e.navCell[i]);
+
+			e.navRoute[i] = (field && from != NAV::kNone ? NAV::routeOf(field[from]) : NAV::kNone);
+		}
+	}
+
+	static void aiSystem(void *context, ui32 begin, ui32 end)
+	{
+		stepContext &ctx = *static_cast<stepContext *>(context);
+		ENT::store &e = ctx.w->entities;
+
+		ui32 rolls[kAIDraws * kAIBlock];
+		ui32 thinkCount = 0;
+
+		// blocks don't straddle the full and reduced ranges, so their dense indices are contiguous
+
+		for (ui32 blockBegin = begin; blockBegin < end; )
+		{
+			ui32 blockEnd = min(end, blockBegin + kAIBlock);
+
+			if (blockBegin < ctx.fullCount)
+			{
+				blockEnd = min(blockEnd, ctx.fullCount);
+			}
+
+			const ui32 first = entityAt(ctx, blockBegin);
+			const ui32 count = blockEnd - blockBegin;
+
+			SIMD::random(e.rng + first, rolls, count, kAIDraws);
+
+			// agents in control of themselves this step and the ones among them whose turn it is to think,
+			// grouped by brain so each tree runs over all of its agents at once
+
+			ui32 agents[kBrainCount][kAIBlock];
+			ui32 agentCount[kBrainCount] = { 0 };
+			ui32 thinkers[kBrainCount][kAIBlock];
+			ui32 thinkerCount[kBrainCount] = { 0 };
+
+			for (ui32 n = blockBegin; n < blockEnd; n++)
+			{
+				ui32 i = first + (n - blockBegin);
+
+				if (!isAgent(e, i))
+				{
+					continue;
+				}
+
+				if (!aiBefore(e, i))
+				{
+					// flying from a kick there's nothing to think about, but landing is worth a thought
+					e.thinkStep[i] = kThinkNow;
+					continue;
+				}
+
+				agents[e.brain[i]][agentCount[e.brain[i]]++] = i;
+
+				if (thinks(ctx, n, i))
+				{
+					thinkers[e.brain[i]][thinkerCount[e.brain[i]]++] = i;
+					e.thinkStep[i] = ctx.w->stepCount + kThinkInterval;
+					thinkCount++;
+				}
+			}
+
+			aiBatch batch;
+			batch.w = ctx.w;
+			batch.ctx = &ctx;
+			batch.rolls = rolls;
+			batch.first = first;
+			batch.count = count;
+			batch.delta = stepTime(ctx, blockBegin);
+
+			for (ui32 brain = 1; brain < kBrainCount; brain++)
+			{
+				BT::run(thinkTrees[brain], leaves, &batch, thinkers[brain], thinkerCount[brain]);
+				BT::run(reflexTrees[brain], leaves, &batch, agents[brain], agentCount[brain]);
+			}
+
+			for (ui32 i = first; i < first + count; i++)
+			{
+				if (isAgent(e, i))
+				{
+					aiAfter(*ctx.w, i, batch.delta);
+				}
+			}
+
+			blockBegin = blockEnd;
+		}
+
+		InterlockedExchangeAdd(&ctx.thinkCount, static_cast<LONG>(thinkCount));
+	}
+
+	// kicks write into somebody else's state, so they're queued during control and applied here on one thread
+
+	static void kickSystem(void *context, ui32 begin, ui32 end)
+	{
+		stepContext &ctx = *static_cast<stepContext *>(context);
+		ENT::store &e = ctx.w->entities;
+
+		for (ui32 n = begin; n < end; n++)
+		{
+			ui32 i = entityAt(ctx, n);
+
+			if (e.kickRequest[i] == kKickNone)
+			{
+				continue;
+			}
+
+			bool flip = (e.kickRequest[i] == kKickRight);
+
+			if (e.kickTarget[i] != kKickEveryone)
+			{
+				kick(e, e.kickTarget[i], flip);
+			}
+			else
+			{
+				// anybody close enough to a kicker to get hit runs at full rate
+
+				for (ui32 j = 0; j < ctx.fullCount; j++)
+				{
+					if (j != i && isCharacter(e, j) && touching(e, i, j))
+					{
+						kick(e, j, flip);
+					}
+				}
+			}
+
+			e.kickRequest[i] = kKickNone;
+		}
+	}
+
+	static void integrateSystem(void *context, ui32 begin, ui32 end)
+	{
+		stepContext &ctx = *static_cast<stepContext *>(context);
+		ENT::store &e = ctx.w->entities;
+
+		// at most two contiguous runs, one from the full rate range and one from the reduced slice
+
+		if (begin < ctx.fullCount)
+		{
+			ui32 last = min(end, ctx.fullCount);
+
+			SIMD::integrate(e.posX + begin, e.posY + begin, e.prevX + begin, e.prevY + begin, e.velX + begin, e.velY + begin, e.accX + begin, e.accY + begin, last - begin, dt);
+
+			begin = last;
+		}
+
+		if (begin < end)
+		{
+			ui32 i = entityAt(ctx, begin);
+
+			SIMD::integrate(e.posX + i, e.posY + i, e.prevX + i, e.prevY + i, e.velX + i, e.velY + i, e.accX + i, e.accY + i, end - begin, kReducedDt);
+		}
+	}
+
+	// one batch per contiguous run of bodies that collide, everything but the camera
+
+	static void collideRun(ENT::store &e, const recti *boxes, ui32 first, ui32 count, i32 stride)
+	{
+		const ui32 end = first + count;
+		ui32 i = first;
+
+		while (i < end)
+		{
+			while (i < end && !(e.flags[i] & ENT::kFlagCollides))
+			{
+				i++;
+			}
+
+			const ui32 run = i;
+
+			while (i < end && (e.flags[i] & ENT::kFlagCollides))
+			{
+				i++;
+			}
+
+			if (i > run)
+			{
+				map_collision_batch(e.posX + run, e.posY + run, e.prevX + run, e.prevY + run, e.velX + run, e.velY + run,
+					e.sprite + run, boxes, e.collides + run, e.contact + run, i - run, stride);
+			}
+		}
+	}
+
+	static void collisionSystem(void *context, ui32 begin, ui32 end)
+	{
+		stepContext &ctx = *static_cast<stepContext *>(context);
+		ENT::store &e = ctx.w->entities;
+		recti boxes[TX::MAX];
+
+		for (i32 sprite = 0; sprite < TX::MAX; sprite++)
+		{
+			boxes[sprite] = boundingBox(sprite, pointf(0.0f, 0.0f));
+		}
+
+		// at most two contiguous runs like integration, reduced entities move a few steps' worth at once
+		// and walk the map in coarser strides
+
+		if (begin < ctx.fullCount)
+		{
+			ui32 last = min(end, ctx.fullCount);
+
+			collideRun(e, boxes, begin, last - begin, 1);
+
+			begin = last;
+		}
+
+		if (begin < end)
+		{
+			collideRun(e, boxes, entityAt(ctx, begin), end - begin, kLodCollisionStride);
+		}
+	}
+
+	static void animationSystem(void *context, ui32 begin, ui32 end)
+	{
+		stepContext &ctx = *static_cast<stepContext *>(context);
+		ENT::store &e = ctx.w->entities;
+
+		for (ui32 n = begin; n < end; n++)
+		{
+			ui32 i = entityAt(ctx, n);
+
+			if (!isCharacter(e, i))
+			{
+				continue;
+			}
+
+			collision::info &collides = e.collides[i];
+
+			if (e.velX[i] == scalar(0) && collides.bottom())
+			{
+				e.frame[i] = 0;
+				e.animTime[i] = scalar(-1.0f);
+			}
+			else if (!collides.bottom())
+			{
+				e.frame[i] = 1;
+				e.animTime[i] = scalar(-1.0f);
+			}
+			else if (e.velX[i] != scalar(0))
+			{
+				if (e.animTime[i] == scalar(-1.0f))
+				{
+					e.frame[i] = 2;
+					e.animTime[i] = scalar(0);
+				}
+
+				e.animTime[i] += stepTime(ctx, n);
+
+				if (e.animTime[i] >= scalar(0.1f))
+				{
+					e.frame[i]++;
+					if (e.frame[i] > 2) e.frame[i] = 1;
+					e.animTime[i] = scalar(0);
+				}
+			}
+
+			if (e.isKicking[i])
+			{
+				e.frame[i] = 3;
+			}
+		}
+	}
+
+	// projectiles go after everything has moved, so they're swept against where characters ended up this
+	// step. Whoever one hits gets kicked like by a player, the kick taking over from next step on. Anybody
+	// running at all can be hit, whatever their rate
+
+	static PRJ::targets projectileTargets;
+
+	static void projectileSystem(void *context, ui32 begin, ui32 end)
+	{
+		stepContext &ctx = *static_cast<stepContext *>(context);
+		world &w = *ctx.w;
+		ENT::store &e = w.entities;
+		PRJ::store &p = w.projectiles;
+
+		if ((ctx.in & kKeyThrow) && !w.keyThrowPressed)
+		{
+			for (ui32 k = 0; k < ctx.playerCount; k++)
+			{
+				ui32 i = ctx.players[k];
+
+				if (e.kickedTime[i] <= kMaxKickedTime)
+				{
+					continue;
+				}
+
+				rects box = characterBox(e, i);
+				vectors position(box.x + box.width * scalar(0.5f), box.y + box.height * scalar(0.5f));
+				vectors velocity(e.flip[i] ? kThrowVelX : -kThrowVelX, kThrowVelY);
+
+				PRJ::spawn(p, position, velocity, kThrowLife, kThrowSize, PRJ::kFlagGravity | PRJ::kFlagBounce | PRJ::kFlagHitsCharacters | PRJ::kFlagDigs, e.id[i]);
+			}
+		}
+
+		w.keyThrowPressed = (ctx.in & kKeyThrow) != 0;
+
+		if (p.count == 0)
+		{
+			return;
+		}
+
+		PRJ::clear(projectileTargets);
+
+		for (ui32 i = 0; i < w.lodReduced; i++)
+		{
+			if (isCharacter(e, i))
+			{
+				PRJ::add(projectileTargets, characterBox(e, i), e.id[i]);
+			}
+		}
+
+		PRJ::sort(projectileTargets);
+
+		if (PRJ::update(p, &projectileTargets, dt, g) > 0)
+		{
+			w.mapEdited = true;
+		}
+
+		for (ui32 k = 0; k < p.count; k++)
+		{
+			if (p.hit[k] != PRJ::kNone && ENT::alive(e, p.hit[k]))
+			{
+				kick(e, ENT::index(e, p.hit[k]), p.velX[k] > scalar(0));
+			}
+		}
+
+		PRJ::removeDead(p);
+	}
+
+	// the step as a task graph, kicks being the barrier before anybody touches
+	// somebody else's state:
+	//
+	//   camera ----------------+
+	//   players --+            +-- integrate -- collision -- animation -- projectiles
+	//   ai -------+-- kicks ---+
+
+	void step(world &w, input in, stats *st)
+	{
+		f64 stepStart = (st ? now() : 0.0);
+		ENT::store &e = w.entities;
+
+		// the graph follows the map's tiles whoever changed them, a rollback included, so it's the same at
+		// this step every time it's run, if not always numbered the same. Routes from before a dig are dropped
+
+		NAV::refresh();
+
+		if (w.mapEdited)
+		{
+			for (ui32 i = 0; i < e.count; i++)
+			{
+				e.navCell[i] = NAV::kNone;
+				e.navRoute[i] = NAV::kNone;
+			}
+
+			w.mapEdited = false;
+		}
+
+		// level of detail, regrouped on a fixed schedule or right away when entities come and go
+
+		if (!w.lod)
+		{
+			w.lodFull = w.lodReduced = w.lodCount = e.count;
+		}
+		else if (w.stepCount % kLodInterval == 0 || w.lodCount != e.count)
+		{
+			updateLod(w);
+		}
+
+		stepContext ctx;
+		ctx.w = &w;
+		ctx.in = in;
+		ctx.playerCount = 0;
+
+		// the reduced range runs a slice at a time, so each of them gets one step per kLodInterval
+
+		const ui32 reduced = w.lodReduced - w.lodFull;
+		const ui32 phase = w.stepCount % kLodInterval;
+		const ui32 sliceEnd = w.lodFull + reduced * (phase + 1) / kLodInterval;
+
+		ctx.fullCount = w.lodFull;
+		ctx.sliceBegin = w.lodFull + reduced * phase / kLodInterval;
+		ctx.activeCount = ctx.fullCount + (sliceEnd - ctx.sliceBegin);
+
+		// ai only goes after players, so gather them once instead of scanning everyone per agent,
+		// players always run at full rate
+
+		for (ui32 i = 0; i < ctx.fullCount && ctx.playerCount < kMaxPlayers; i++)
+		{
+			if (e.flags[i] & ENT::kFlagPlayer)
+			{
+				ctx.players[ctx.playerCount++] = i;
+			}
+		}
+
+		ctx.thinkTurn = (ctx.activeCount > 0 ? w.thinkTurn % ctx.activeCount : 0);
+		ctx.thinkCount = 0;
+
+		JOB::graph tasks;
+
+		ui32 camera = JOB::add(tasks, cameraSystem, &ctx, 1, 1);
+		ui32 players = JOB::add(tasks, playerSystem, &ctx, ctx.playerCount, kMaxPlayers);
+		ui32 nav = JOB::add(tasks, navSystem, &ctx, 1, 1);
+		ui32 ai = JOB::add(tasks, aiSystem, &ctx, ctx.activeCount, kAIGrain, (1u << nav));
+		ui32 kicks = JOB::add(tasks, kickSystem, &ctx, ctx.activeCount, max(ctx.activeCount, 1u), (1u << players) | (1u << ai));
+		ui32 integrate = JOB::add(tasks, integrateSystem, &ctx, ctx.activeCount, kIntegrateGrain, (1u << camera) | (1u << kicks));
+		ui32 collision = JOB::add(tasks, collisionSystem, &ctx, ctx.activeCount, kCollisionGrain, (1u << integrate));
+		ui32 animation = JOB::add(tasks, animationSystem, &ctx, ctx.activeCount, kAnimationGrain, (1u << collision));
+		JOB::add(tasks, projectileSystem, &ctx, 1, 1, (1u << animation));
+
+		static const Phase taskPhase[] = { kPhaseCamera, kPhaseControl, kPhaseControl, kPhaseControl, kPhaseKicks, kPhaseIntegrate, kPhaseCollision, kPhaseAnimation, kPhaseProjectiles };
+		f64 taskTime[JOB::kMaxTasks];
+
+		JOB::run(tasks, st ? taskTime : 0);
+
+		// step finished
+
+		w.thinkTurn = ctx.thinkTurn + kThinksPerStep;
+		w.t += kStepTime;
+		w.stepCount++;
+
+		if (st)
+		{
+			for (ui32 i = 0; i < tasks.taskCount; i++)
+			{
+				st->phaseTime[taskPhase[i]] += taskTime[i];
+			}
+
+			st->totalTime += now() - stepStart;
+			st->steps++;
+			st->thinks += ctx.thinkCount;
+		}
+	}
+
+	void printStats(FILE *file, const stats &st)
+	{
+		static const char *phaseNames[kPhaseCount] = { "camera", "control", "kicks", "integrate", "collision", "animation", "projectiles" };
+
+		f64 stepsPerSecond = (st.totalTime > 0.0 ? st.steps / st.totalTime : 0.0);
+
+		fprintf(file, "steps:            %u\n", st.steps);
+		fprintf(file, "total time:       %.6f s\n", st.totalTime);
+		fprintf(file, "steps per second: %.1f\n", stepsPerSecond);
+
+		for (int i = 0; i < kPhaseCount; i++)
+		{
+			f64 average = (st.steps > 0 ? st.phaseTime[i] / st.steps : 0.0);
+			f64 share = (st.totalTime > 0.0 ? 100.0 * st.phaseTime[i] / st.totalTime : 0.0);
+
+			fprintf(file, "  %-11s %10.3f us/step %6.2f%%\n", phaseNames[i], average * 1000000.0, share);
+		}
+
+		fprintf(file, "ai thinks:        %.1f per step\n", st.steps > 0 ? static_cast<f64>(st.thinks) / st.steps : 0.0);
+	}
+}
+
+rectf boundingBox(i32 sprite_id, const pointf &pos)
+{
+	TX::sprite &sprite = TX::sprites[sprite_id];
+
+	return rectf(pos.x - (f32)sprite.origin.x + 10.0f, pos.y - (f32)sprite.origin.y + 2.0f, 32.0f, 77.0f);
+}
@@ -0,0 +1,150 @@
+// SIM stands for simulation. Everything that runs inside a fixed step lives
+// here, so it doesn't need a window, a clock or a keyboard to work.
+
+namespace SIM
+{
+	// constants
+
+	const f32 kStepTime = 0.01f; // seconds of real time per step, for the frame loop
+	const scalar kVel = scalar(250.f);
+	const scalar kJump = scalar(550.0f);
+	const scalar g = scalar(9.8f * 150.0f);
+	const scalar kMaxKickedTime = scalar(1.5f);
+	const scalar dt = scalar(kStepTime);
+	const ui32 kKickSteps = 10;
+	const ui32 kMaxPlayers = 4;
+
+	// what players throw: a small square that falls, bounces off tiles and kicks whoever it hits
+	const scalar kThrowVelX = scalar(1500.0f);
+	const scalar kThrowVelY = scalar(-300.0f);
+	const scalar kThrowLife = scalar(3.0f);
+	const ui8 kThrowSize = 4;
+
+	enum Direction { kNone, kLeft, kRight, kBottom, kTop };
+
+	// level of detail, by distance along either axis to the camera, its target or a player: close
+	// entities run every step, farther ones run every kLodInterval steps with a longer dt and coarser
+	// collision, and the rest don't run at all until something comes near them again. Full rate reaches
+	// kLodMargin past the edges of the view around each of them, and reduced rate kLodReducedBand past that
+
+	enum Lod { kLodFull = 0, kLodReduced, kLodFrozen };
+
+	// which behaviour trees an ai character runs: ruby wanders, chasers go after the nearest player
+	enum Brain { kBrainNone = 0, kBrainRuby, kBrainChaser, kBrainCount };
+
+	const i32 kLodMargin = 384;
+	const i32 kLodReducedBand = 3072;
+	const ui32 kLodInterval = 4;
+	const i32 kLodCollisionStride = 8;
+
+	// ai thinking is scheduled: every step an agent only follows through on what it already decided,
+	// and it thinks again every kThinkInterval steps, as soon as it hits a wall or gets over a kick, and
+	// every step within kThinkNearDistance of a player. Past that agents take turns, a budget given in
+	// microseconds a step worth of them at a time. The budget is turned into agents with a fixed estimate
+	// of what one costs instead of a clock, so the same steps make the same choices on any machine
+
+	const ui32 kThinkInterval = 10;
+	const i32 kThinkNearDistance = 256;
+	const ui32 kThinkBudget = 20;    // microseconds per step
+	const ui32 kThinkCost = 40;      // nanoseconds per agent, an estimate
+	const ui32 kThinksPerStep = kThinkBudget * 1000 / kThinkCost;
+	const ui32 kThinkNow = 0xFFFFFFFF; // as an agent's thinkStep, think as soon as it can
+
+	// input for a single step as a bitmask, 0 being the null input
+
+	enum Key
+	{
+		kKeyUp = 0x01,
+		kKeyLeft = 0x02,
+		kKeyRight = 0x04,
+		kKeyKick = 0x08,
+		kKeyCamera = 0x10,
+		kKeyExit = 0x20,
+		kKeyThrow = 0x40
+	};
+
+	typedef ui8 input;
+
+	// per phase timing, only collected when a stats object is passed to step()
+
+	enum Phase
+	{
+		kPhaseCamera = 0,
+		kPhaseControl,
+		kPhaseKicks,
+		kPhaseIntegrate,
+		kPhaseCollision,
+		kPhaseAnimation,
+		kPhaseProjectiles,
+		kPhaseCount
+	};
+
+	struct stats
+	{
+		f64 phaseTime[kPhaseCount];
+		f64 totalTime;
+		ui32 steps;
+		ui64 thinks;
+
+		stats() : totalTime(0.0), steps(0), thinks(0) { for (int i = 0; i < kPhaseCount; i++) phaseTime[i] = 0.0; }
+	};
+
+	// everything a step reads or writes, kept as plain data with no pointers so it can be copied around whole
+
+	struct world
+	{
+		ENT::store entities;
+		PRJ::store projectiles;
+
+		// the camera is a body like any other, it just doesn't collide and isn't drawn
+
+		ENT::handle camera;
+		ENT::handle cameraTarget;
+
+		// the view the world is run for, set once by init(). It's where the camera stops at the map's edges
+		// and how far full rate reaches, so the window showing it can change size without changing the run
+
+		sizei viewSize;
+
+		// input state that carries over between steps
+
+		bool keyCtrlPressed;
+		bool keySpacePressed;
+		bool keyThrowPressed;
+
+		// set by a step that dug into the map, the next one forgets routes found on the old one
+
+		bool mapEdited;
+
+		// dense indices are kept ordered as [full | reduced | frozen], regrouped every kLodInterval steps
+
+		bool lod;
+		i32 lodFullDistance;
+		i32 lodFrozenDistance;
+		ui32 lodFull;
+		ui32 lodReduced;
+		ui32 lodCount;
+
+		// first agent whose turn it is to think next step, see kThinkBudget
+
+		ui32 thinkTurn;
+
+		// virtual clock
+
+		f64 t;
+		ui32 stepCount;
+
+		// every character gets its own stream seeded from these, the world's own stream places crowds
+
+		ui32 seed;
+		ui32 spawnCount;
+		RNG::stream rng;
+	};
+
+	void init(world &w, sizei viewSize, ui32 seed = 1);
+	ENT::handle spawnCharacter(world &w, i32 sprite, pointf position, ui8 flags);
+	void spawnCrowd(world &w, ui32 count, Brain brain = kBrainRuby);
+	void step(world &w, input in, stats *st = 0);
+	void printStats(FILE *file, const stats &st);
+	f64 now();
+}
@@ -0,0 +1,675 @@
+#include <stdlib.h>
+#include <string.h>
+#include <intrin.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+#include "elementals.h"
+#include "fixed.h"
+#include "rng.h"
+#include "simd.h"
+
+// AVX2 intrinsics came with Visual Studio 2012, building with an older compiler leaves the level out
+#if _MSC_VER >= 1700
+#define SIMD_AVX2
+#endif
+
+namespace SIMD
+{
+	typedef void (*integrateFn)(f32 *, f32 *, f32 *, f32 *, f32 *, f32 *, const f32 *, const f32 *, ui32, f32);
+	typedef void (*interpolateFn)(const f32 *, const f32 *, f32 *, ui32, f32);
+	typedef void (*sweepSpansFn)(const f32 *, const f32 *, i32 *, i32 *, ui32);
+	typedef void (*decodePixelsFn)(const ui8 *, ui32, const ui32 *, const ui8 *, ui32, ui8 *, ui32);
+
+	// scalar tails, same operations in the same order as the vector bodies
+
+	static void integrateScalar(f32 *posX, f32 *posY, f32 *prevX, f32 *prevY, f32 *velX, f32 *velY, const f32 *accX, const f32 *accY, ui32 begin, ui32 end, f32 dt)
+	{
+		for (ui32 i = begin; i < end; i++)
+		{
+			prevX[i] = posX[i];
+			prevY[i] = posY[i];
+
+			velX[i] += accX[i] * dt;
+			velY[i] += accY[i] * dt;
+			posX[i] += velX[i] * dt;
+			posY[i] += velY[i] * dt;
+		}
+	}
+
+	static void interpolateScalar(const f32 *cur, const f32 *prev, f32 *out, ui32 begin, ui32 end, f32 alpha)
+	{
+		for (ui32 i = begin; i < end; i++)
+		{
+			out[i] = floorf(cur[i] * alpha + prev[i] * (1.0f - alpha));
+		}
+	}
+
+	static void sweepSpansScalar(const f32 *prev, const f32 *cur, i32 *from, i32 *to, ui32 begin, ui32 end)
+	{
+		for (ui32 i = begin; i < end; i++)
+		{
+			const bool forward = cur[i] > prev[i];
+
+			from[i] = (forward ? floorToInt(prev[i]) : ceilToInt(prev[i]));
+			to[i] = (forward ? ceilToInt(cur[i]) : floorToInt(cur[i]));
+		}
+	}
+
+	// SSE2
+
+	static inline __m128 floorSSE2(__m128 x)
+	{
+		// truncate, then step down where truncation went up (negative non-integers)
+		__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+		return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+	}
+
+	// the same two as integers, a true compare is -1 so adding it steps down and subtracting it steps up
+
+	static inline __m128i floorIntSSE2(__m128 x)
+	{
+		__m128i t = _mm_cvttps_epi32(x);
+		return _mm_add_epi32(t, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(t), x)));
+	}
+
+	static inline __m128i ceilIntSSE2(__m128 x)
+	{
+		__m128i t = _mm_cvttps_epi32(x);
+		return _mm_sub_epi32(t, _mm_castps_si128(_mm_cmplt_ps(_mm_cvtepi32_ps(t), x)));
+	}
+
+	static inline __m128i selectSSE2(__m128i mask, __m128i a, __m128i b)
+	{
+		return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+	}
+
+	static void integrateSSE2(f32 *posX, f32 *posY, f32 *prevX, f32 *prevY, f32 *velX, f32 *velY, const f32 *accX, const f32 *accY, ui32 count, f32 dt)
+	{
+		const __m128 vdt = _mm_set1_ps(dt);
+		ui32 i = 0;
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 px = _mm_loadu_ps(posX + i);
+			__m128 py = _mm_loadu_ps(posY + i);
+			__m128 vx = _mm_loadu_ps(velX + i);
+			__m128 vy = _mm_loadu_ps(velY + i);
+
+			_mm_storeu_ps(prevX + i, px);
+			_mm_storeu_ps(prevY + i, py);
+
+			vx = _mm_add_ps(vx, _mm_mul_ps(_mm_loadu_ps(accX + i), vdt));
+			vy = _mm_add_ps(vy, _mm_mul_ps(_mm_loadu_ps(accY + i), vdt));
+			px = _mm_add_ps(px, _mm_mul_ps(vx, vdt));
+			py = _mm_add_ps(py, _mm_mul_ps(vy, vdt));
+
+			_mm_storeu_ps(velX + i, vx);
+			_mm_storeu_ps(velY + i, vy);
+			_mm_storeu_ps(posX + i, px);
+			_mm_storeu_ps(posY + i, py);
+		}
+
+		integrateScalar(posX, posY, prevX, prevY, velX, velY, accX, accY, i, count, dt);
+	}
+
+	static void interpolateSSE2(const f32 *cur, const f32 *prev, f32 *out, ui32 count, f32 alpha)
+	{
+		const __m128 a = _mm_set1_ps(alpha);
+		const __m128 b = _mm_set1_ps(1.0f - alpha);
+		ui32 i = 0;
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(cur + i), a), _mm_mul_ps(_mm_loadu_ps(prev + i), b));
+			_mm_storeu_ps(out + i, floorSSE2(v));
+		}
+
+		interpolateScalar(cur, prev, out, i, count, alpha);
+	}
+
+	static void sweepSpansSSE2(const f32 *prev, const f32 *cur, i32 *from, i32 *to, ui32 count)
+	{
+		ui32 i = 0;
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 p = _mm_loadu_ps(prev + i);
+			__m128 c = _mm_loadu_ps(cur + i);
+			__m128i forward = _mm_castps_si128(_mm_cmpgt_ps(c, p));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(from + i), selectSSE2(forward, floorIntSSE2(p), ceilIntSSE2(p)));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(to + i), selectSSE2(forward, ceilIntSSE2(c), floorIntSSE2(c)));
+		}
+
+		sweepSpansScalar(prev, cur, from, to, i, count);
+	}
+
+	// AVX
+
+	static void integrateAVX(f32 *posX, f32 *posY, f32 *prevX, f32 *prevY, f32 *velX, f32 *velY, const f32 *accX, const f32 *accY, ui32 count, f32 dt)
+	{
+		const __m256 vdt = _mm256_set1_ps(dt);
+		ui32 i = 0;
+
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 px = _mm256_loadu_ps(posX + i);
+			__m256 py = _mm256_loadu_ps(posY + i);
+			__m256 vx = _mm256_loadu_ps(velX + i);
+			__m256 vy = _mm256_loadu_ps(velY + i);
+
+			_mm256_storeu_ps(prevX + i, px);
+			_mm256_storeu_ps(prevY + i, py);
+
+			vx = _mm256_add_ps(vx, _mm256_mul_ps(_mm256_loadu_ps(accX + i), vdt));
+			vy = _mm256_add_ps(vy, _mm256_mul_ps(_mm256_loadu_ps(accY + i), vdt));
+			px = _mm256_add_ps(px, _mm256_mul_ps(vx, vdt));
+			py = _mm256_add_ps(py, _mm256_mul_ps(vy, vdt));
+
+			_mm256_storeu_ps(velX + i, vx);
+			_mm256_storeu_ps(velY + i, vy);
+			_mm256_storeu_ps(posX + i, px);
+			_mm256_storeu_ps(posY + i, py);
+		}
+
+		_mm256_zeroupper();
+
+		integrateScalar(posX, posY, prevX, prevY, velX, velY, accX, accY, i, count, dt);
+	}
+
+	static void interpolateAVX(const f32 *cur, const f32 *prev, f32 *out, ui32 count, f32 alpha)
+	{
+		const __m256 a = _mm256_set1_ps(alpha);
+		const __m256 b = _mm256_set1_ps(1.0f - alpha);
+		ui32 i = 0;
+
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(cur + i), a), _mm256_mul_ps(_mm256_loadu_ps(prev + i), b));
+			_mm256_storeu_ps(out + i, _mm256_floor_ps(v));
+		}
+
+		_mm256_zeroupper();
+
+		interpolateScalar(cur, prev, out, i, count, alpha);
+	}
+
+	static void sweepSpansAVX(const f32 *prev, const f32 *cur, i32 *from, i32 *to, ui32 count)
+	{
+		ui32 i = 0;
+
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 p = _mm256_loadu_ps(prev + i);
+			__m256 c = _mm256_loadu_ps(cur + i);
+			__m256 forward = _mm256_cmp_ps(c, p, _CMP_GT_OS);
+
+			// rounded values are whole, so truncating them to integers is exact
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(from + i), _mm256_cvttps_epi32(_mm256_blendv_ps(_mm256_ceil_ps(p), _mm256_floor_ps(p), forward)));
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(to + i), _mm256_cvttps_epi32(_mm256_blendv_ps(_mm256_floor_ps(c), _mm256_ceil_ps(c), forward)));
+		}
+
+		_mm256_zeroupper();
+
+		sweepSpansScalar(prev, cur, from, to, i, count);
+	}
+
+	// map decoding: pixels are turned into 0xRRGGBB colours four to a register and looked up in the palette
+	// with a compare per entry, the later entries first so the first one that matches wins
+
+	static void decodePixelsScalar(const ui8 *pixels, ui32 bytesPerPixel, const ui32 *colors, const ui8 *tiles, ui32 paletteCount, ui8 *out, ui32 begin, ui32 end)
+	{
+		for (ui32 i = begin; i < end; i++)
+		{
+			const ui8 *p = pixels + i * bytesPerPixel;
+			const ui32 color = p[0] | (p[1] << 8) | (p[2] << 16);
+			ui8 tile = 0;
+
+			for (ui32 k = paletteCount; k-- > 0;)
+			{
+				if (color == colors[k]) tile = tiles[k];
+			}
+
+			out[i] = tile;
+		}
+	}
+
+	struct paletteSSE2
+	{
+		__m128i colors[kMaxPalette];
+		__m128i tiles[kMaxPalette];
+		ui32 count;
+
+		paletteSSE2(const ui32 *c, const ui8 *t, ui32 n) : count(n)
+		{
+			for (ui32 k = 0; k < count; k++)
+			{
+				colors[k] = _mm_set1_epi32(static_cast<int>(c[k]));
+				tiles[k] = _mm_set1_epi32(t[k]);
+			}
+		}
+
+		inline __m128i lookup(__m128i color) const
+		{
+			__m128i result = _mm_setzero_si128();
+
+			for (ui32 k = count; k-- > 0;)
+			{
+				__m128i match = _mm_cmpeq_epi32(color, colors[k]);
+				result = _mm_or_si128(_mm_and_si128(match, tiles[k]), _mm_andnot_si128(match, result));
+			}
+
+			return result;
+		}
+	};
+
+	// sixteen looked up colours, one tile number in each 32 bit lane, packed into sixteen bytes
+	static inline void storeTilesSSE2(ui8 *out, __m128i a, __m128i b, __m128i c, __m128i d)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+	}
+
+	static inline __m128i load24SSE2(const ui8 *p)
+	{
+		ui32 a, b, c, d;
+
+		memcpy(&a, p, 4);
+		memcpy(&b, p + 3, 4);
+		memcpy(&c, p + 6, 4);
+		memcpy(&d, p + 9, 4);
+
+		return _mm_setr_epi32(static_cast<int>(a), static_cast<int>(b), static_cast<int>(c), static_cast<int>(d));
+	}
+
+	// 32 bit pixels are one word each. 24 bit ones are read a word at a time from every third byte,
+	// which reads a byte past the pixel, so the last pixel of the row is always left to the scalar tail
+
+	static void decodePixelsSSE2(const ui8 *pixels, ui32 bytesPerPixel, const ui32 *colors, const ui8 *tiles, ui32 paletteCount, ui8 *out, ui32 count)
+	{
+		const paletteSSE2 palette(colors, tiles, paletteCount);
+		const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+		ui32 i = 0;
+
+		if (bytesPerPixel == 4)
+		{
+			for (; i + 16 <= count; i += 16)
+			{
+				const __m128i *p = reinterpret_cast<const __m128i *>(pixels + i * 4);
+
+				storeTilesSSE2(out + i,
+					palette.lookup(_mm_and_si128(_mm_loadu_si128(p), rgb)),
+					palette.lookup(_mm_and_si128(_mm_loadu_si128(p + 1), rgb)),
+					palette.lookup(_mm_and_si128(_mm_loadu_si128(p + 2), rgb)),
+					palette.lookup(_mm_and_si128(_mm_loadu_si128(p + 3), rgb)));
+			}
+		}
+		else if (bytesPerPixel == 3)
+		{
+			for (; i + 16 < count; i += 16)
+			{
+				const ui8 *p = pixels + i * 3;
+
+				storeTilesSSE2(out + i,
+					palette.lookup(_mm_and_si128(load24SSE2(p), rgb)),
+					palette.lookup(_mm_and_si128(load24SSE2(p + 12), rgb)),
+					palette.lookup(_mm_and_si128(load24SSE2(p + 24), rgb)),
+					palette.lookup(_mm_and_si128(load24SSE2(p + 36), rgb)));
+			}
+		}
+
+		decodePixelsScalar(pixels, bytesPerPixel, colors, tiles, paletteCount, out, i, count);
+	}
+
+	// AVX has no 256 bit integer compares, but every CPU with it has SSSE3's byte shuffle, which spreads four
+	// 24 bit pixels out of a single load. It reads four bytes past them, so the tail is a little longer
+
+	static void decodePixelsAVX(const ui8 *pixels, ui32 bytesPerPixel, const ui32 *colors, const ui8 *tiles, ui32 paletteCount, ui8 *out, ui32 count)
+	{
+		if (bytesPerPixel != 3)
+		{
+			decodePixelsSSE2(pixels, bytesPerPixel, colors, tiles, paletteCount, out, count);
+			return;
+		}
+
+		const paletteSSE2 palette(colors, tiles, paletteCount);
+		const __m128i spread = _mm_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128);
+		ui32 i = 0;
+
+		for (; i + 18 <= count; i += 16)
+		{
+			const ui8 *p = pixels + i * 3;
+
+			storeTilesSSE2(out + i,
+				palette.lookup(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), spread)),
+				palette.lookup(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 12)), spread)),
+				palette.lookup(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 24)), spread)),
+				palette.lookup(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 36)), spread)));
+		}
+
+		decodePixelsScalar(pixels, bytesPerPixel, colors, tiles, paletteCount, out, i, count);
+	}
+
+#ifdef SIMD_AVX2
+
+	// AVX2 compares eight colours at once. Four registers of tile numbers pack down to 32 bytes within each
+	// 128 bit half, so a dword permute puts the halves back in pixel order
+
+	struct paletteAVX2
+	{
+		__m256i colors[kMaxPalette];
+		__m256i tiles[kMaxPalette];
+		ui32 count;
+
+		paletteAVX2(const ui32 *c, const ui8 *t, ui32 n) : count(n)
+		{
+			for (ui32 k = 0; k < count; k++)
+			{
+				colors[k] = _mm256_set1_epi32(static_cast<int>(c[k]));
+				tiles[k] = _mm256_set1_epi32(t[k]);
+			}
+		}
+
+		inline __m256i lookup(__m256i color) const
+		{
+			__m256i result = _mm256_setzero_si256();
+
+			for (ui32 k = count; k-- > 0;)
+			{
+				result = _mm256_blendv_epi8(result, tiles[k], _mm256_cmpeq_epi32(color, colors[k]));
+			}
+
+			return result;
+		}
+	};
+
+	static inline void storeTilesAVX2(ui8 *out, __m256i a, __m256i b, __m256i c, __m256i d)
+	{
+		const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+		const __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_permutevar8x32_epi32(packed, order));
+	}
+
+	// eight 24 bit pixels, four spread out of each 128 bit half the same way the AVX kernel does it
+	static inline __m256i load24AVX2(const ui8 *p, __m256i spread)
+	{
+		const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 12));
+
+		return _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1), spread);
+	}
+
+	static void decodePixelsAVX2(const ui8 *pixels, ui32 bytesPerPixel, const ui32 *colors, const ui8 *tiles, ui32 paletteCount, ui8 *out, ui32 count)
+	{
+		const paletteAVX2 palette(colors, tiles, paletteCount);
+		ui32 i = 0;
+
+		if (bytesPerPixel == 4)
+		{
+			const __m256i rgb = _mm256_set1_epi32(0x00FFFFFF);
+
+			for (; i + 32 <= count; i += 32)
+			{
+				const __m256i *p = reinterpret_cast<const __m256i *>(pixels + i * 4);
+
+				storeTilesAVX2(out + i,
+					palette.lookup(_mm256_and_si256(_mm256_loadu_si256(p), rgb)),
+					palette.lookup(_mm256_and_si256(_mm256_loadu_si256(p + 1), rgb)),
+					palette.lookup(_mm256_and_si256(_mm256_loadu_si256(p + 2), rgb)),
+					palette.lookup(_mm256_and_si256(_mm256_loadu_si256(p + 3), rgb)));
+			}
+		}
+		else if (bytesPerPixel == 3)
+		{
+			const __m256i spread = _mm256_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128,
+				0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128);
+
+			// the last load reads four bytes past the pixels it spreads, like the AVX kernel's
+
+			for (; i + 34 <= count; i += 32)
+			{
+				const ui8 *p = pixels + i * 3;
+
+				storeTilesAVX2(out + i,
+					palette.lookup(load24AVX2(p, spread)),
+					palette.lookup(load24AVX2(p + 24, spread)),
+					palette.lookup(load24AVX2(p + 48, spread)),
+					palette.lookup(load24AVX2(p + 72, spread)));
+			}
+		}
+
+		_mm256_zeroupper();
+
+		decodePixelsScalar(pixels, bytesPerPixel, colors, tiles, paletteCount, out, i, count);
+	}
+
+#endif
+
+	// dispatch
+
+	static Level currentLevel = kSSE2;
+	static integrateFn integrateImpl = integrateSSE2;
+	static interpolateFn interpolateImpl = interpolateSSE2;
+	static sweepSpansFn sweepSpansImpl = sweepSpansSSE2;
+	static decodePixelsFn decodePixelsImpl = decodePixelsSSE2;
+
+	static bool cpuHasAVX()
+	{
+		int info[4];
+		__cpuid(info, 1);
+
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+
+		// the OS has to be saving the ymm registers on context switches too
+		return avx && osxsave && (_xgetbv(0) & 0x6) == 0x6;
+	}
+
+	// only asked once AVX is known to be usable, AVX2 uses the same registers
+	static bool cpuHasAVX2()
+	{
+		int info[4];
+		__cpuid(info, 0);
+
+		if (info[0] < 7)
+		{
+			return false;
+		}
+
+		__cpuidex(info, 7, 0);
+
+		return (info[1] & (1 << 5)) != 0;
+	}
+
+	void init(bool allowAVX)
+	{
+		currentLevel = kSSE2;
+		integrateImpl = integrateSSE2;
+		interpolateImpl = interpolateSSE2;
+		sweepSpansImpl = sweepSpansSSE2;
+		decodePixelsImpl = decodePixelsSSE2;
+
+		if (allowAVX && cpuHasAVX())
+		{
+			currentLevel = kAVX;
+			integrateImpl = integrateAVX;
+			interpolateImpl = interpolateAVX;
+			sweepSpansImpl = sweepSpansAVX;
+			decodePixelsImpl = decodePixelsAVX;
+
+#ifdef SIMD_AVX2
+			if (cpuHasAVX2())
+			{
+				currentLevel = kAVX2;
+				decodePixelsImpl = decodePixelsAVX2;
+			}
+#endif
+		}
+	}
+
+	Level level()
+	{
+		return currentLevel;
+	}
+
+	const char *levelName()
+	{
+		return (currentLevel == kAVX2 ? "AVX2" : currentLevel == kAVX ? "AVX" : "SSE2");
+	}
+
+	void integrate(f32 *posX, f32 *posY, f32 *prevX, f32 *prevY, f32 *velX, f32 *velY, const f32 *accX, const f32 *accY, ui32 count, f32 dt)
+	{
+		integrateImpl(posX, posY, prevX, prevY, velX, velY, accX, accY, count, dt);
+	}
+
+	void interpolate(const f32 *cur, const f32 *prev, f32 *out, ui32 count, f32 alpha)
+	{
+		interpolateImpl(cur, prev, out, count, alpha);
+	}
+
+	void sweepSpans(const f32 *prev, const f32 *cur, i32 *from, i32 *to, ui32 count)
+	{
+		sweepSpansImpl(prev, cur, from, to, count);
+	}
+
+	void decodePixels(const ui8 *pixels, ui32 bytesPerPixel, const ui32 *colors, const ui8 *tiles, ui32 paletteCount, ui8 *out, ui32 count)
+	{
+		decodePixelsImpl(pixels, bytesPerPixel, colors, tiles, paletteCount, out, count);
+	}
+
+	// random streams, four at a time with their state words transposed into registers
+
+	template<int k> static inline __m128i rotlSSE2(__m128i x)
+	{
+		return _mm_or_si128(_mm_slli_epi32(x, k), _mm_srli_epi32(x, 32 - k));
+	}
+
+	static inline void transposeSSE2(__m128i &a, __m128i &b, __m128i &c, __m128i &d)
+	{
+		__m128i t0 = _mm_unpacklo_epi32(a, b);
+		__m128i t1 = _mm_unpacklo_epi32(c, d);
+		__m128i t2 = _mm_unpackhi_epi32(a, b);
+		__m128i t3 = _mm_unpackhi_epi32(c, d);
+
+		a = _mm_unpacklo_epi64(t0, t1);
+		b = _mm_unpackhi_epi64(t0, t1);
+		c = _mm_unpacklo_epi64(t2, t3);
+		d = _mm_unpackhi_epi64(t2, t3);
+	}
+
+	void random(RNG::stream *streams, ui32 *out, ui32 count, ui32 draws)
+	{
+		ui32 i = 0;
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i s0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(streams + i));
+			__m128i s1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(streams + i + 1));
+			__m128i s2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(streams + i + 2));
+			__m128i s3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(streams + i + 3));
+
+			// from one stream per register to one state word per register
+			transposeSSE2(s0, s1, s2, s3);
+
+			for (ui32 d = 0; d < draws; d++)
+			{
+				// rotl(s1 * 5, 7) * 9, the multiplies as shifts and adds since SSE2 has no 32 bit mullo
+				__m128i r = rotlSSE2<7>(_mm_add_epi32(_mm_slli_epi32(s1, 2), s1));
+				r = _mm_add_epi32(_mm_slli_epi32(r, 3), r);
+
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(out + d * count + i), r);
+
+				__m128i t = _mm_slli_epi32(s1, 9);
+
+				s2 = _mm_xor_si128(s2, s0);
+				s3 = _mm_xor_si128(s3, s1);
+				s1 = _mm_xor_si128(s1, s2);
+				s0 = _mm_xor_si128(s0, s3);
+				s2 = _mm_xor_si128(s2, t);
+				s3 = rotlSSE2<11>(s3);
+			}
+
+			transposeSSE2(s0, s1, s2, s3);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(streams + i), s0);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(streams + i + 1), s1);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(streams + i + 2), s2);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(streams + i + 3), s3);
+		}
+
+		for (; i < count; i++)
+		{
+			for (ui32 d = 0; d < draws; d++)
+			{
+				out[d * count + i] = RNG::next(streams[i]);
+			}
+		}
+	}
+
+	// fixed point
+
+	void integrate(fixed *posX, fixed *posY, fixed *prevX, fixed *prevY, fixed *velX, fixed *velY, const fixed *accX, const fixed *accY, ui32 count, fixed dt)
+	{
+		for (ui32 i = 0; i < count; i++)
+		{
+			prevX[i] = posX[i];
+			prevY[i] = posY[i];
+
+			velX[i] += accX[i] * dt;
+			velY[i] += accY[i] * dt;
+			posX[i] += velX[i] * dt;
+			posY[i] += velY[i] * dt;
+		}
+	}
+
+	void interpolate(const fixed *cur, const fixed *prev, f32 *out, ui32 count, f32 alpha)
+	{
+		const __m128 scale = _mm_set1_ps(1.0f / fixed::kOne);
+		const __m128 a = _mm_set1_ps(alpha);
+		const __m128 b = _mm_set1_ps(1.0f - alpha);
+		ui32 i = 0;
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 c = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + i))), scale);
+			__m128 p = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(prev + i))), scale);
+
+			_mm_storeu_ps(out + i, floorSSE2(_mm_add_ps(_mm_mul_ps(c, a), _mm_mul_ps(p, b))));
+		}
+
+		for (; i < count; i++)
+		{
+			out[i] = floorf(toFloat(cur[i]) * alpha + toFloat(prev[i]) * (1.0f - alpha));
+		}
+	}
+
+	void sweepSpans(const fixed *prev, const fixed *cur, i32 *from, i32 *to, ui32 count)
+	{
+		// floor is a plain arithmetic shift of the raw value and ceil rounds up to the next whole one first
+		const __m128i almostOne = _mm_set1_epi32(fixed::kOne - 1);
+		ui32 i = 0;
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(prev + i));
+			__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + i));
+			__m128i forward = _mm_cmpgt_epi32(c, p);
+
+			__m128i pf = _mm_srai_epi32(p, fixed::kShift);
+			__m128i pc = _mm_srai_epi32(_mm_add_epi32(p, almostOne), fixed::kShift);
+			__m128i cf = _mm_srai_epi32(c, fixed::kShift);
+			__m128i cc = _mm_srai_epi32(_mm_add_epi32(c, almostOne), fixed::kShift);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(from + i), selectSSE2(forward, pf, pc));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(to + i), selectSSE2(forward, cc, cf));
+		}
+
+		for (; i < count; i++)
+		{
+			const bool forward = cur[i] > prev[i];
+
+			from[i] = (forward ? floorToInt(prev[i]) : ceilToInt(prev[i]));
+			to[i] = (forward ? ceilToInt(cur[i]) : floorToInt(cur[i]));
+		}
+	}
+}
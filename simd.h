@@ -0,0 +1,43 @@
+// Vectorized kernels over packed entity arrays. SSE2 is the baseline, the
+// AVX versions get picked by init() when both the CPU and the OS support it.
+// AVX2 on top of that only has a kernel of its own for map decoding so far,
+// everything else keeps to the AVX ones there.
+// Arrays don't need to be aligned and counts don't need to be multiples of
+// the vector width.
+
+namespace SIMD
+{
+	enum Level { kSSE2 = 0, kAVX, kAVX2 };
+
+	void init(bool allowAVX = true);
+	Level level();
+	const char *levelName();
+
+	// prev = pos; vel += acc * dt; pos += vel * dt
+	void integrate(f32 *posX, f32 *posY, f32 *prevX, f32 *prevY, f32 *velX, f32 *velY, const f32 *accX, const f32 *accY, ui32 count, f32 dt);
+
+	// out = floor(cur * alpha + prev * (1 - alpha))
+	void interpolate(const f32 *cur, const f32 *prev, f32 *out, ui32 count, f32 alpha);
+
+	// the pixels map_collision walks a body between along one axis: floor(prev) to ceil(cur) when it moves
+	// forward, ceil(prev) to floor(cur) otherwise
+	void sweepSpans(const f32 *prev, const f32 *cur, i32 *from, i32 *to, ui32 count);
+
+	// palette colours a scanline can be looked up in at once
+	const ui32 kMaxPalette = 16;
+
+	// out[i] = tiles[k] for the first k with colors[k] == pixel i's colour as 0xRRGGBB, 0 if there's none.
+	// Pixels are 3 or 4 bytes in blue, green, red order, the way FreeImage keeps them on Windows; alpha is
+	// ignored. paletteCount is at most kMaxPalette
+	void decodePixels(const ui8 *pixels, ui32 bytesPerPixel, const ui32 *colors, const ui8 *tiles, ui32 paletteCount, ui8 *out, ui32 count);
+
+	// out[d * count + i] = the d-th next number of streams[i], for d < draws. Integer only, so the numbers
+	// are the ones RNG::next() gives on any path. AVX has no 256 bit integer ops and there's no AVX2 kernel
+	// for it yet, so every level uses SSE2
+	void random(RNG::stream *streams, ui32 *out, ui32 count, ui32 draws);
+
+	// fixed point versions, integration stays in integer math so it's exact on any path
+	void integrate(fixed *posX, fixed *posY, fixed *prevX, fixed *prevY, fixed *velX, fixed *velY, const fixed *accX, const fixed *accY, ui32 count, fixed dt);
+	void interpolate(const fixed *cur, const fixed *prev, f32 *out, ui32 count, f32 alpha);
+	void sweepSpans(const fixed *prev, const fixed *cur, i32 *from, i32 *to, ui32 count);
+}
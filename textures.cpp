@@ -8,6 +8,39 @@ namespace TX
 {
 	sprite sprites[TX::MAX];
 
+	static void buildMask(sprite &s, const BYTE *bits, int pitch)
+	{
+		const int columns = s.size.width / s.tileSize.width;
+		const int width = (s.tileSize.width < kMaskWidth ? s.tileSize.width : kMaskWidth);
+		const int height = s.tileSize.height;
+
+		s.frames = columns * (s.size.height / height);
+		s.mask = new ui64[s.frames * height * 2];
+
+		ui64 *mirrored = s.mask + s.frames * height;
+
+		for (int f = 0; f < s.frames; f++)
+		{
+			for (int y = 0; y < height; y++)
+			{
+				const BYTE *pixels = bits + ((f / columns) * height + y) * pitch + (f % columns) * s.tileSize.width * 4;
+				ui64 row = 0, flipped = 0;
+
+				for (int x = 0; x < width; x++)
+				{
+					if (pixels[x * 4 + FI_RGBA_ALPHA] >= 128)
+						row |= static_cast<ui64>(1) << x;
+
+					if (pixels[(s.tileSize.width - 1 - x) * 4 + FI_RGBA_ALPHA] >= 128)
+						flipped |= static_cast<ui64>(1) << x;
+				}
+
+				s.mask[f * height + y] = row;
+				mirrored[f * height + y] = flipped;
+			}
+		}
+	}
+
 	bool load(int id, const char *filename, pointi origin, sizei tileSize, bool repeat)
 	{
 		FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(filename, 0);
@@ -52,7 +85,6 @@ namespace TX
 		FreeImage_Unload(dib);
 
 		GFX::loadTexture(id, width, height, bits, repeat);
-		free(bits);
 
 		sprites[id].size.width = width;
 		sprites[id].size.height = height;
@@ -64,9 +96,61 @@ namespace TX
 			sprites[id].tileSize.height = tileSize.height;
 		}
 
+		delete[] sprites[id].mask;
+		sprites[id].mask = 0;
+		sprites[id].frames = 0;
+
+		if (sprites[id].tileSize.width && sprites[id].tileSize.height)
+		{
+			buildMask(sprites[id], bits, pitch);
+		}
+
+		free(bits);
+
 		return true;
 	}
 
+	const ui64 *maskRows(int id, int frame, bool flip)
+	{
+		const sprite &s = sprites[id];
+		const int height = s.tileSize.height;
+
+		return s.mask + ((flip ? s.frames : 0) + frame % s.frames) * height;
+	}
+
+	bool masksOverlap(int idA, int frameA, bool flipA, pointi a, int idB, int frameB, bool flipB, pointi b)
+	{
+		const sprite &sa = sprites[idA];
+		const sprite &sb = sprites[idB];
+		const int widthA = (sa.tileSize.width < kMaskWidth ? sa.tileSize.width : kMaskWidth);
+		const int widthB = (sb.tileSize.width < kMaskWidth ? sb.tileSize.width : kMaskWidth);
+
+		if (b.x >= a.x + widthA || a.x >= b.x + widthB || b.y >= a.y + sa.tileSize.height || a.y >= b.y + sb.tileSize.height)
+		{
+			return false;
+		}
+
+		// b's rows shifted into a's columns, less than a mask's width either way after the test above
+
+		const ui64 *rowsA = maskRows(idA, frameA, flipA);
+		const ui64 *rowsB = maskRows(idB, frameB, flipB);
+		const int dx = b.x - a.x;
+		const int top = (a.y > b.y ? a.y : b.y);
+		const int bottom = (a.y + sa.tileSize.height < b.y + sb.tileSize.height ? a.y + sa.tileSize.height : b.y + sb.tileSize.height);
+
+		for (int y = top; y < bottom; y++)
+		{
+			const ui64 rowB = rowsB[y - b.y];
+
+			if (rowsA[y - a.y] & (dx >= 0 ? rowB << dx : rowB >> -dx))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
 	void saveImage(const char *filename, int width, int height, ui8 *data)
 	{
 		FIBITMAP *image = FreeImage_Allocate(width, height, 24);
@@ -28,15 +28,28 @@ namespace TX
 		kShadowTlBlTrBr
 	};
 
+	// masks keep one bit per pixel of a frame that's at least half opaque, a 64 bit word per row, so frames
+	// wider than this lose what's past it
+	const int kMaskWidth = 64;
+
 	struct sprite
 	{
 		sizei size;
 		pointi origin;
 		sizei tileSize;
+		int frames;
+		ui64 *mask; // frames * tileSize.height rows, then the same again mirrored for flipped frames, 0 if there's none
 	};
 
 	bool load(int id, const char *filename, pointi origin = pointi(), sizei tileSize = sizei(), bool repeat = false);
 
+	// rows of a frame's mask from the top, bit x is pixel x from the left as it's drawn
+	const ui64 *maskRows(int id, int frame, bool flip);
+
+	// whether two frames drawn with their top left corners at the given pixels have an opaque pixel in common,
+	// their rectangles are checked first so frames apart cost next to nothing
+	bool masksOverlap(int idA, int frameA, bool flipA, pointi a, int idB, int frameB, bool flipB, pointi b);
+
 	void saveImage(const char *filename, int width, int height, ui8 *data);
 
 	extern sprite sprites[TX::MAX];